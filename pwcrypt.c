@@ -11,7 +11,23 @@
  *		[--no-confirm] \
  *		[--type='email'] \
  *		[--algorithm='SHA512'] \
- *		[--salt='UD23qlwjerf']
+ *		[--salt='UD23qlwjerf'] \
+ *		[--output-fd=3]
+ *
+ * To generate several hashes of one passphrase, one per line:
+ *
+ *	pwcrypt --hash='SHA512:100000' --hash='SHA256'
+ *
+ * To check a passphrase against a stored hash, queueing a new hash if the
+ * stored one is not per the --hash policy, with the passphrase then the
+ * stored hash on stdin (or the hash on --verify-fd), never as arguments,
+ * which any local user can see:
+ *
+ *	printf '%s\n%s\n' "$PASSPHRASE" "$STORED_HASH" | pwcrypt \
+ *		--verify \
+ *		--hash='SHA512:100000' \
+ *		--user='alice' \
+ *		--upgrade-queue='/var/lib/mailpw/upgrades'
  *
  * To test against your own passwd, get your salt:
  *
@@ -28,6 +44,7 @@
 #include <assert.h>
 #include <err.h>
 #include <crypt.h>		/* Link with -lcrypt */
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,6 +53,22 @@
 #include <termios.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
+
+/* USDT probes for perf/bpftrace, enabled by "make profile"; the probe
+ * arguments never include the salt or the passphrase.
+ * see: pwcrypt-latency.bt */
+#if defined(PWCRYPT_USDT) && PWCRYPT_USDT
+#if defined(__has_include) && !__has_include(<sys/sdt.h>)
+#error "PWCRYPT_USDT needs <sys/sdt.h>, e.g.: from systemtap-sdt-dev"
+#endif
+#include <sys/sdt.h>
+#define pwcrypt_probe(name) DTRACE_PROBE(pwcrypt, name)
+#define pwcrypt_probe2(name, a, b) DTRACE_PROBE2(pwcrypt, name, a, b)
+#else
+#define pwcrypt_probe(name) do { } while (0)
+#define pwcrypt_probe2(name, a, b) do { (void)(a); (void)(b); } while (0)
+#endif
 
 /* see the "Notes" section of "man 3 crypt" for glibc crypt_r
  * algorithm options */
@@ -44,8 +77,39 @@
 #define CRYPT_SHA256 "5"
 #define CRYPT_SHA512 "6"
 
+/* the SHA256 and SHA512 rounds when none are given, and the range which
+ * crypt_r accepts, see "man 5 crypt" */
+#define CRYPT_DEFAULT_ROUNDS 5000
+#define CRYPT_MIN_ROUNDS 1000
+#define CRYPT_MAX_ROUNDS 999999999
+
 const char *pwcrypt_version_str = "1.0.0";
 
+/* an algorithm, as passed to crypt_algo, and the number of rounds, with 0
+ * meaning the crypt_r default */
+struct pwcrypt_spec {
+	char algorithm[40];
+	unsigned long rounds;
+};
+
+/* the most "--hash" options accepted */
+#define PWCRYPT_MAX_SPECS 16
+
+/* the size of the buffer for the stored hash read by --verify */
+#define PWCRYPT_MAX_HASH 512
+
+/* a single crypt_r call, possibly on its own thread */
+struct pwcrypt_job {
+	const char *passphrase;
+	const char *algo;
+	unsigned long rounds;
+	char algo_salt[256];
+	struct crypt_data data;
+	char *encrypted;
+	pthread_t thread;
+	int started;
+};
+
 /* prototypes */
 char *chomp_crlf(char *str, size_t max);
 void getpw(char *buf, char *buf2, size_t size, const char *type, int confirm,
@@ -53,14 +117,138 @@ void getpw(char *buf, char *buf2, size_t size, const char *type, int confirm,
 void getrandom_salt(char *buf, size_t size);
 char *fgets_no_echo(char *buf, int size, FILE *stream);
 int is_valid_for_salt(char c);
+unsigned long salt_rounds(const char *salt);
 const char *crypt_algo(const char *in);
 void *alloc_madvised_or_die(size_t *memory_size, unsigned pages);
 void free_madvised(void *memory, size_t memory_size);
+int pwcrypt_hashes(FILE *out, int confirm, const char *type,
+		   const struct pwcrypt_spec *specs, size_t num_specs,
+		   const char *user_salt,
+		   char *(*fgets_func)(char *buf, int size, FILE *tty),
+		   FILE *tty);
+void pwcrypt_job_init(struct pwcrypt_job *job, const struct pwcrypt_spec *spec,
+		      const char *user_salt);
+void *pwcrypt_job_run(void *arg);
+int parse_hash_spec(const char *str, struct pwcrypt_spec *spec);
+int hash_matches_spec(const char *hash, const struct pwcrypt_spec *spec);
+int hashes_equal(const char *a, const char *b);
+int crypt_failed(const char *hash);
+int pwcrypt_verify(FILE *out, FILE *stored_in,
+		   const struct pwcrypt_spec *upgrade, const char *user,
+		   const char *upgrade_queue, const char *type, FILE *in,
+		   char *(*fgets_func)(char *buf, int size, FILE *tty),
+		   FILE *tty);
+int queue_upgrade(const char *upgrade_queue, const char *user,
+		  const char *old_hash, const char *new_hash);
+FILE *fdopen_option(const char *name, const char *num, const char *mode);
 
 /* functions */
 int pwcrypt(FILE *out, int confirm, const char *type,
 	    const char *algorithm, const char *user_salt,
 	    char *(*fgets_func)(char *buf, int size, FILE *tty), FILE *tty)
+{
+	struct pwcrypt_spec spec;
+	memset(&spec, 0x00, sizeof(struct pwcrypt_spec));
+	if (algorithm) {
+		if (strlen(algorithm) >= sizeof(spec.algorithm)) {
+			errx(EXIT_FAILURE, "algorithm '%s' too long", algorithm);
+		}
+		strcpy(spec.algorithm, algorithm);
+	}
+
+	return pwcrypt_hashes(out, confirm, type, &spec, 1, user_salt,
+			      fgets_func, tty);
+}
+
+/* Reads the passphrase once, then writes one hash per spec, each on its
+ * own line, in the order of the specs. When there is more than one spec,
+ * the crypt_r calls run concurrently, one thread each. */
+int pwcrypt_hashes(FILE *out, int confirm, const char *type,
+		   const struct pwcrypt_spec *specs, size_t num_specs,
+		   const char *user_salt,
+		   char *(*fgets_func)(char *buf, int size, FILE *tty),
+		   FILE *tty)
+{
+	assert(specs);
+	assert(num_specs);
+
+	struct pwcrypt_job *jobs = calloc(num_specs, sizeof(struct pwcrypt_job));
+	if (!jobs) {
+		err(EXIT_FAILURE, "calloc(%zu, %zu) failed", num_specs,
+		    sizeof(struct pwcrypt_job));
+	}
+
+	for (size_t i = 0; i < num_specs; ++i) {
+		pwcrypt_job_init(&jobs[i], &specs[i], user_salt);
+	}
+
+	size_t memory_size = 0;
+	unsigned pages = 1;
+	pwcrypt_probe(alloc_madvised_start);
+	void *memory = alloc_madvised_or_die(&memory_size, pages);
+	pwcrypt_probe(alloc_madvised_done);
+	assert(memory_size);
+
+	const size_t plaintext_passphrase_size = memory_size / 2;
+	char *plaintext_passphrase = memory;
+	char *plaintext_passphrase2 =
+	    plaintext_passphrase + plaintext_passphrase_size;
+
+	pwcrypt_probe(getpw_start);
+	getpw(plaintext_passphrase, plaintext_passphrase2,
+	      plaintext_passphrase_size, type, confirm, fgets_func, tty);
+	pwcrypt_probe(getpw_done);
+
+	for (size_t i = 0; i < num_specs; ++i) {
+		jobs[i].passphrase = plaintext_passphrase;
+	}
+
+	if (num_specs == 1) {
+		pwcrypt_job_run(&jobs[0]);
+	} else {
+		for (size_t i = 0; i < num_specs; ++i) {
+			jobs[i].started = !pthread_create(&jobs[i].thread, NULL,
+							  pwcrypt_job_run,
+							  &jobs[i]);
+			if (!jobs[i].started) {
+				/* no thread, run it here instead */
+				pwcrypt_job_run(&jobs[i]);
+			}
+		}
+		for (size_t i = 0; i < num_specs; ++i) {
+			if (jobs[i].started) {
+				pthread_join(jobs[i].thread, NULL);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < num_specs; ++i) {
+		jobs[i].passphrase = NULL;
+	}
+	plaintext_passphrase = NULL;
+	plaintext_passphrase2 = NULL;
+	pwcrypt_probe(free_madvised_start);
+	free_madvised(memory, memory_size);
+	pwcrypt_probe(free_madvised_done);
+
+	for (size_t i = 0; i < num_specs; ++i) {
+		if (crypt_failed(jobs[i].encrypted)) {
+			err(EXIT_FAILURE, "crypt_r failed");
+		}
+	}
+
+	for (size_t i = 0; i < num_specs; ++i) {
+		fprintf(out, "%s\n", jobs[i].encrypted);
+	}
+
+	memset(jobs, 0x00, num_specs * sizeof(struct pwcrypt_job));
+	free(jobs);
+
+	return 0;
+}
+
+void pwcrypt_job_init(struct pwcrypt_job *job, const struct pwcrypt_spec *spec,
+		      const char *user_salt)
 {
 	/* The salt_buf_size is arbitrary, but user_salt may also contain
 	 * "rounds" or other data. From man crypt_r:
@@ -82,44 +270,246 @@ int pwcrypt(FILE *out, int confirm, const char *type,
 	} else {
 		/* limit imposed by crypt_r */
 		const size_t salt_max_len = 16;
+		pwcrypt_probe(getrandom_salt_start);
 		getrandom_salt(salt_buf, salt_max_len + 1);
+		pwcrypt_probe(getrandom_salt_done);
 	}
 
-	const char *algo = crypt_algo(algorithm);
-	const size_t algo_salt_size = salt_buf_size + 10;
-	char algo_salt[algo_salt_size];
-	snprintf(algo_salt, algo_salt_size, "$%s$%s$", algo, salt_buf);
+	job->algo = crypt_algo(spec->algorithm);
+	if (spec->rounds) {
+		if (strcmp(job->algo, CRYPT_SHA512) != 0
+		    && strcmp(job->algo, CRYPT_SHA256) != 0) {
+			errx(EXIT_FAILURE, "rounds not supported for '%s'",
+			     spec->algorithm);
+		}
+		job->rounds = spec->rounds;
+		snprintf(job->algo_salt, sizeof(job->algo_salt),
+			 "$%s$rounds=%lu$%s$", job->algo, job->rounds,
+			 salt_buf);
+	} else {
+		job->rounds = salt_rounds(salt_buf);
+		snprintf(job->algo_salt, sizeof(job->algo_salt), "$%s$%s$",
+			 job->algo, salt_buf);
+	}
 
-	struct crypt_data data;
 	/* data->initialized = 0; */
-	memset(&data, 0x00, sizeof(struct crypt_data));
+	memset(&job->data, 0x00, sizeof(struct crypt_data));
+}
+
+void *pwcrypt_job_run(void *arg)
+{
+	struct pwcrypt_job *job = arg;
+
+	pwcrypt_probe2(crypt_r_start, job->algo, job->rounds);
+	job->encrypted = crypt_r(job->passphrase, job->algo_salt, &job->data);
+	pwcrypt_probe(crypt_r_done);
+
+	return NULL;
+}
+
+/* parses "ALGORITHM" or "ALGORITHM:ROUNDS", with ROUNDS in the range
+ * crypt_r accepts, returns 0 on success */
+int parse_hash_spec(const char *str, struct pwcrypt_spec *spec)
+{
+	assert(spec);
+
+	memset(spec, 0x00, sizeof(struct pwcrypt_spec));
+	if (!str || !str[0]) {
+		return 1;
+	}
+
+	const char *colon = strchr(str, ':');
+	size_t algorithm_len = colon ? (size_t)(colon - str) : strlen(str);
+	if (!algorithm_len || algorithm_len >= sizeof(spec->algorithm)) {
+		return 1;
+	}
+	memcpy(spec->algorithm, str, algorithm_len);
+
+	if (colon) {
+		const char *digits = colon + 1;
+		char *end = NULL;
+		if (*digits < '1' || *digits > '9') {
+			return 1;
+		}
+		spec->rounds = strtoul(digits, &end, 10);
+		if (*end != '\0' || spec->rounds < CRYPT_MIN_ROUNDS
+		    || spec->rounds > CRYPT_MAX_ROUNDS) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* returns non-zero if the hash was made with the algorithm, and for
+ * SHA256 and SHA512 the number of rounds, of the spec */
+int hash_matches_spec(const char *hash, const struct pwcrypt_spec *spec)
+{
+	assert(spec);
+
+	if (!hash || hash[0] != '$') {
+		return 0;
+	}
+	const char *id = hash + 1;
+	const char *id_end = strchr(id, '$');
+	if (!id_end) {
+		return 0;
+	}
+
+	const char *algo = crypt_algo(spec->algorithm);
+	size_t id_len = (size_t)(id_end - id);
+	if (strlen(algo) != id_len || strncmp(id, algo, id_len) != 0) {
+		return 0;
+	}
+
+	if (strcmp(algo, CRYPT_SHA512) != 0
+	    && strcmp(algo, CRYPT_SHA256) != 0) {
+		return 1;
+	}
+	unsigned long rounds = salt_rounds(id_end + 1);
+	unsigned long wanted = spec->rounds;
+	rounds = rounds ? rounds : CRYPT_DEFAULT_ROUNDS;
+	wanted = wanted ? wanted : CRYPT_DEFAULT_ROUNDS;
+	return rounds == wanted;
+}
+
+/* compares all of the characters, rather than stopping at the first which
+ * differs, thus the time taken does not tell how much of a hash matched */
+int hashes_equal(const char *a, const char *b)
+{
+	assert(a);
+	assert(b);
+
+	size_t a_len = strlen(a);
+	size_t b_len = strlen(b);
+	unsigned char diff = (a_len != b_len) ? 1 : 0;
+	for (size_t i = 0; i < a_len; ++i) {
+		diff |= (unsigned char)(a[i] ^ b[i < b_len ? i : 0]);
+	}
+	return !diff;
+}
+
+/* crypt_r returns NULL, or with libxcrypt a "*0" or "*1" failure token
+ * (never a valid hash), if it fails */
+int crypt_failed(const char *hash)
+{
+	return !hash || hash[0] == '*';
+}
+
+/* Reads the passphrase, from "in" if not NULL, otherwise prompting on the
+ * tty, then the stored hash, a line from stored_in (which may be "in"),
+ * and returns 0 if the passphrase matches the stored hash.
+ *
+ * If it matches, but the stored hash is not per the upgrade spec (if any),
+ * a new hash is made per the spec, then appended to the upgrade_queue as
+ * "USER TAB OLD-HASH TAB NEW-HASH", or written to out if there is no
+ * queue. A failure to upgrade is only a warning; the passphrase still
+ * matched. */
+int pwcrypt_verify(FILE *out, FILE *stored_in,
+		   const struct pwcrypt_spec *upgrade, const char *user,
+		   const char *upgrade_queue, const char *type, FILE *in,
+		   char *(*fgets_func)(char *buf, int size, FILE *tty),
+		   FILE *tty)
+{
+	assert(stored_in);
+	assert(in || tty);
+
+	struct pwcrypt_job *job = calloc(1, sizeof(struct pwcrypt_job));
+	if (!job) {
+		err(EXIT_FAILURE, "calloc(1, %zu) failed",
+		    sizeof(struct pwcrypt_job));
+	}
 
 	size_t memory_size = 0;
 	unsigned pages = 1;
 	void *memory = alloc_madvised_or_die(&memory_size, pages);
 	assert(memory_size);
-
-	const size_t plaintext_passphrase_size = memory_size / 2;
 	char *plaintext_passphrase = memory;
-	char *plaintext_passphrase2 =
-	    plaintext_passphrase + plaintext_passphrase_size;
 
-	getpw(plaintext_passphrase, plaintext_passphrase2,
-	      plaintext_passphrase_size, type, confirm, fgets_func, tty);
+	if (in) {
+		if (!fgets(plaintext_passphrase, (int)memory_size, in)) {
+			errx(EXIT_FAILURE, "no passphrase");
+		}
+		chomp_crlf(plaintext_passphrase, memory_size);
+	} else {
+		int confirm = 0;
+		getpw(plaintext_passphrase, NULL, memory_size, type, confirm,
+		      fgets_func, tty);
+	}
 
-	char *encrypted = crypt_r(plaintext_passphrase, algo_salt, &data);
+	char stored[PWCRYPT_MAX_HASH];
+	if (!fgets(stored, sizeof(stored), stored_in)) {
+		free_madvised(memory, memory_size);
+		errx(EXIT_FAILURE, "no stored hash");
+	}
+	chomp_crlf(stored, sizeof(stored));
+
+	/* not the stored hash, which contains the salt */
+	pwcrypt_probe2(crypt_r_start, "verify", 0UL);
+	const char *computed = crypt_r(plaintext_passphrase, stored,
+				       &job->data);
+	pwcrypt_probe(crypt_r_done);
+	int match = !crypt_failed(computed) && hashes_equal(computed, stored);
+	int upgrading = match && upgrade && !hash_matches_spec(stored, upgrade);
+
+	if (upgrading) {
+		pwcrypt_job_init(job, upgrade, NULL);
+		job->passphrase = plaintext_passphrase;
+		pwcrypt_job_run(job);
+		job->passphrase = NULL;
+	}
 
 	plaintext_passphrase = NULL;
-	plaintext_passphrase2 = NULL;
 	free_madvised(memory, memory_size);
 
-	if (!encrypted) {
-		err(EXIT_FAILURE, "crypt_r failed");
+	if (!crypt_failed(job->encrypted)) {
+		if (!upgrade_queue) {
+			fprintf(out, "%s\n", job->encrypted);
+		} else if (queue_upgrade(upgrade_queue, user, stored,
+					 job->encrypted)) {
+			warn("could not queue the upgrade of '%s' to '%s'",
+			     user, upgrade_queue);
+		}
+	} else if (upgrading) {
+		warnx("crypt_r failed, not upgraded");
 	}
 
-	fprintf(out, "%s\n", encrypted);
+	memset(job, 0x00, sizeof(struct pwcrypt_job));
+	free(job);
 
-	return 0;
+	return match ? 0 : 1;
+}
+
+/* Appends the line with a single write to the file opened O_APPEND, thus
+ * concurrent verifiers do not interleave their lines. Returns 0 on
+ * success. */
+int queue_upgrade(const char *upgrade_queue, const char *user,
+		  const char *old_hash, const char *new_hash)
+{
+	assert(upgrade_queue);
+	assert(user);
+	assert(old_hash);
+	assert(new_hash);
+
+	char *line = NULL;
+	int len = asprintf(&line, "%s\t%s\t%s\n", user, old_hash, new_hash);
+	if (len < 0) {
+		return 1;
+	}
+
+	int fd = open(upgrade_queue, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+		      0600);
+	if (fd < 0) {
+		free(line);
+		return 1;
+	}
+	ssize_t written = write(fd, line, (size_t)len);
+	int error = (written != len) ? 1 : 0;
+	if (close(fd)) {
+		error = 1;
+	}
+	free(line);
+
+	return error;
 }
 
 void *alloc_madvised_or_die(size_t *memory_size, unsigned pages)
@@ -270,6 +660,24 @@ void getrandom_salt(char *buf, size_t size)
 	} while (len < max);
 }
 
+/* returns the N of a leading "rounds=N$", or 0 for the crypt_r default */
+unsigned long salt_rounds(const char *salt)
+{
+	const char *prefix = "rounds=";
+	const size_t prefix_len = strlen(prefix);
+
+	if (!salt || strncmp(salt, prefix, prefix_len) != 0) {
+		return 0;
+	}
+
+	char *end = NULL;
+	unsigned long rounds = strtoul(salt + prefix_len, &end, 10);
+	if (end == salt + prefix_len || *end != '$') {
+		return 0;
+	}
+	return rounds;
+}
+
 char *chomp_crlf(char *str, size_t size)
 {
 	if (!str) {
@@ -311,7 +719,11 @@ int is_valid_for_salt(char c)
 
 void pwcrypt_parse_options(int *help, int *version, int *no_confirm,
 			   const char **type, const char **algorithm,
-			   const char **salt, int argc, char **argv)
+			   const char **salt, const char **output_fd,
+			   struct pwcrypt_spec *specs, size_t *num_specs,
+			   int *verify, const char **verify_fd,
+			   const char **user, const char **upgrade_queue,
+			   int argc, char **argv)
 {
 	assert(help);
 	assert(version);
@@ -319,11 +731,18 @@ void pwcrypt_parse_options(int *help, int *version, int *no_confirm,
 	assert(type);
 	assert(algorithm);
 	assert(salt);
+	assert(output_fd);
+	assert(specs);
+	assert(num_specs);
+	assert(verify);
+	assert(verify_fd);
+	assert(user);
+	assert(upgrade_queue);
 	assert(argc);
 	assert(argv);
 
 	/* omg, optstirng is horrible */
-	const char *optstring = "hvnt::a::s::";
+	const char *optstring = "hvnt::a::s::o::H::VF::u::q::";
 	struct option long_options[] = {
 		{ "help", no_argument, 0, 'h' },
 		{ "version", no_argument, 0, 'v' },
@@ -331,6 +750,12 @@ void pwcrypt_parse_options(int *help, int *version, int *no_confirm,
 		{ "type", optional_argument, 0, 't' },
 		{ "algorithm", optional_argument, 0, 'a' },
 		{ "salt", optional_argument, 0, 's' },
+		{ "output-fd", optional_argument, 0, 'o' },
+		{ "hash", optional_argument, 0, 'H' },
+		{ "verify", no_argument, 0, 'V' },
+		{ "verify-fd", optional_argument, 0, 'F' },
+		{ "user", optional_argument, 0, 'u' },
+		{ "upgrade-queue", optional_argument, 0, 'q' },
 		{ 0, 0, 0, 0 }
 	};
 
@@ -363,12 +788,61 @@ void pwcrypt_parse_options(int *help, int *version, int *no_confirm,
 		case 's':
 			*salt = optarg;
 			break;
+		case 'o':
+			*output_fd = optarg;
+			break;
+		case 'H':
+			if (*num_specs >= PWCRYPT_MAX_SPECS) {
+				errx(EXIT_FAILURE, "more than %d --hash options",
+				     PWCRYPT_MAX_SPECS);
+			}
+			if (parse_hash_spec(optarg, &specs[*num_specs])) {
+				errx(EXIT_FAILURE, "invalid --hash '%s'",
+				     optarg ? optarg : "");
+			}
+			++(*num_specs);
+			break;
+		case 'V':
+			*verify = 1;
+			break;
+		case 'F':
+			*verify_fd = optarg;
+			break;
+		case 'u':
+			*user = optarg;
+			break;
+		case 'q':
+			*upgrade_queue = optarg;
+			break;
+		case '?':
+			/* getopt_long has printed the error, e.g.: the old
+			 * "--verify=HASH", which must not be mistaken for a
+			 * request for a new hash */
+			exit(EXIT_FAILURE);
 		default:	/* can this happen? */
 			break;
 		}
 	}
 }
 
+/* fdopen()s the NUM of a "--name=NUM" file descriptor option, or exits */
+FILE *fdopen_option(const char *name, const char *num, const char *mode)
+{
+	assert(name);
+	assert(mode);
+
+	char *end = NULL;
+	long fd = num ? strtol(num, &end, 10) : -1;
+	if (!num || end == num || *end != '\0' || fd < 0) {
+		errx(EXIT_FAILURE, "invalid --%s '%s'", name, num ? num : "");
+	}
+	FILE *stream = fdopen((int)fd, mode);
+	if (!stream) {
+		err(EXIT_FAILURE, "fdopen(%ld, %s) failed", fd, mode);
+	}
+	return stream;
+}
+
 void pwcrypt_help(FILE *out)
 {
 	fprintf(out, "%s:%s() %d: \n", __FILE__, __func__, __LINE__);
@@ -382,18 +856,54 @@ void pwcrypt_help(FILE *out)
 	fprintf(out, "                               ");
 	fprintf(out, "   or other values supported by crypt_r(3).\n");
 
+	fprintf(out, "  -HSPEC, --hash=SPEC          ");
+	fprintf(out, "   Output a hash for SPEC, which is ALGORITHM\n");
+	fprintf(out, "                               ");
+	fprintf(out, "   or ALGORITHM:ROUNDS. May be repeated, one\n");
+	fprintf(out, "                               ");
+	fprintf(out, "   line of output per SPEC.\n");
+
 	fprintf(out, "  -h, --help                   ");
 	fprintf(out, "   Prints this message and exits.\n");
 
 	fprintf(out, "  -n, --no-confirm             ");
 	fprintf(out, "   Do not prompt to re-enter the passphrase.\n");
 
+	fprintf(out, "  -oNUM, --output-fd=NUM       ");
+	fprintf(out, "   Write the hash to file descriptor NUM\n");
+	fprintf(out, "                               ");
+	fprintf(out, "   rather than to stdout.\n");
+
 	fprintf(out, "  -sSTRING, --salt=STRING      ");
 	fprintf(out, "   Use the STRING as the salt.\n");
 
 	fprintf(out, "  -tSTRING, --type=STRING      ");
 	fprintf(out, "   Add the STRING to the prompt.\n");
 
+	fprintf(out, "  -qPATH, --upgrade-queue=PATH ");
+	fprintf(out, "   With --verify, append upgraded hashes to\n");
+	fprintf(out, "                               ");
+	fprintf(out, "   PATH, rather than writing them out.\n");
+
+	fprintf(out, "  -uNAME, --user=NAME          ");
+	fprintf(out, "   The user named in the --upgrade-queue.\n");
+
+	fprintf(out, "  -V, --verify                 ");
+	fprintf(out, "   Exit 0 if the passphrase matches the stored\n");
+	fprintf(out, "                               ");
+	fprintf(out, "   hash, read from the line of stdin after the\n");
+	fprintf(out, "                               ");
+	fprintf(out, "   passphrase, otherwise 1. If it matches, but\n");
+	fprintf(out, "                               ");
+	fprintf(out, "   the hash is not per the --hash SPEC, make a\n");
+	fprintf(out, "                               ");
+	fprintf(out, "   new hash.\n");
+
+	fprintf(out, "  -FNUM, --verify-fd=NUM       ");
+	fprintf(out, "   With --verify, read the stored hash from\n");
+	fprintf(out, "                               ");
+	fprintf(out, "   file descriptor NUM rather than stdin.\n");
+
 	fprintf(out, "  -v, --version                ");
 	fprintf(out, "   Prints the version (%s) and exits.\n",
 		pwcrypt_version_str);
@@ -412,9 +922,17 @@ int pwcrypt_cli(int argc, char **argv, FILE *out)
 	const char *type = NULL;
 	const char *algorithm = NULL;
 	const char *salt = NULL;
+	const char *output_fd = NULL;
+	struct pwcrypt_spec specs[PWCRYPT_MAX_SPECS];
+	size_t num_specs = 0;
+	int verify = 0;
+	const char *verify_fd = NULL;
+	const char *user = NULL;
+	const char *upgrade_queue = NULL;
 
 	pwcrypt_parse_options(&help, &version, &no_confirm, &type, &algorithm,
-			      &salt, argc, argv);
+			      &salt, &output_fd, specs, &num_specs, &verify,
+			      &verify_fd, &user, &upgrade_queue, argc, argv);
 
 	if (help) {
 		pwcrypt_help(out);
@@ -424,16 +942,69 @@ int pwcrypt_cli(int argc, char **argv, FILE *out)
 		pwcrypt_version(out);
 		return EXIT_SUCCESS;
 	}
-	FILE *tty = fopen("/dev/tty", "r+");
-	if (!tty) {
-		err(EXIT_FAILURE, "fopen(/dev/tty, r+) failed");
+	if (algorithm && num_specs) {
+		errx(EXIT_FAILURE, "--algorithm can not be used with --hash");
+	}
+	if (verify && (algorithm || salt || num_specs > 1)) {
+		errx(EXIT_FAILURE, "--verify takes at most one --hash,"
+		     " and no --algorithm or --salt");
+	}
+	if (verify_fd && !verify) {
+		errx(EXIT_FAILURE, "--verify-fd needs --verify");
+	}
+	if (upgrade_queue && (!verify || !user)) {
+		errx(EXIT_FAILURE, "--upgrade-queue needs --verify and --user");
+	}
+	if (user && (!user[0] || strpbrk(user, "\t\n"))) {
+		errx(EXIT_FAILURE, "invalid --user '%s'", user);
+	}
+	FILE *hash_out = out;
+	if (output_fd) {
+		hash_out = fdopen_option("output-fd", output_fd, "w");
+	}
+
+	/* a verifier is usually given the passphrase, then the stored hash,
+	 * on a pipe */
+	FILE *in = (verify && !isatty(STDIN_FILENO)) ? stdin : NULL;
+	FILE *stored_in = in;
+	if (verify_fd) {
+		stored_in = fdopen_option("verify-fd", verify_fd, "r");
+	} else if (verify && !in) {
+		errx(EXIT_FAILURE, "--verify reads the stored hash from stdin,"
+		     " which is a terminal, use --verify-fd");
+	}
+	FILE *tty = NULL;
+	if (!in) {
+		tty = fopen("/dev/tty", "r+");
+		if (!tty) {
+			err(EXIT_FAILURE, "fopen(/dev/tty, r+) failed");
+		}
 	}
 
 	int confirm = no_confirm ? 0 : 1;
-	int rv = pwcrypt(out, confirm, type, algorithm, salt,
-			 fgets_no_echo, tty);
+	int rv;
+	if (verify) {
+		rv = pwcrypt_verify(hash_out, stored_in,
+				    num_specs ? &specs[0] : NULL, user,
+				    upgrade_queue, type, in, fgets_no_echo,
+				    tty);
+	} else if (num_specs) {
+		rv = pwcrypt_hashes(hash_out, confirm, type, specs, num_specs,
+				    salt, fgets_no_echo, tty);
+	} else {
+		rv = pwcrypt(hash_out, confirm, type, algorithm, salt,
+			     fgets_no_echo, tty);
+	}
 
-	fclose(tty);
+	if (tty) {
+		fclose(tty);
+	}
+	if (stored_in && stored_in != in) {
+		fclose(stored_in);
+	}
+	if (hash_out != out && fclose(hash_out)) {
+		err(EXIT_FAILURE, "fclose of --output-fd %s failed", output_fd);
+	}
 
 	return rv;
 }
@@ -0,0 +1,102 @@
+#!/usr/bin/env perl
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright (C) 2021 Eric Herman <eric@freesa.org>
+
+# Generates a directory with a "mailpw.conf" and the password files it
+# refers to, for benchmarking mailpw at scale:
+#
+#	perl tests/bench-mailpw-fixtures.pl --dir=/tmp/bench \
+#		--instances=4 --files=2 --users=100000
+#
+# Each instance gets the given number of files, alternating between the
+# "space" and "passwd" formats, each containing the given number of users
+# named by bench_user_name(). Can also be loaded via "do", see
+# tests/bench-mailpw.pl
+
+use strict;
+use warnings;
+
+use File::Path qw( make_path );
+use Getopt::Long;
+
+exit( bench_fixtures_main(@ARGV) ) unless caller();
+
+sub bench_fixtures_main {
+    local @ARGV = @_;
+
+    my %opts = (
+        dir       => undef,
+        instances => 1,
+        files     => 2,
+        users     => 1000,
+    );
+    GetOptions(
+        'dir=s'       => \$opts{dir},
+        'instances=i' => \$opts{instances},
+        'files=i'     => \$opts{files},
+        'users=i'     => \$opts{users},
+    ) or die("bad options\n");
+    die("--dir is required\n") unless $opts{dir};
+
+    my $conf_path = generate_bench_fixtures(%opts);
+    print "$conf_path\n";
+
+    return 0;
+}
+
+sub bench_user_name {
+    my ($i) = @_;
+    return sprintf( "user%07d", $i );
+}
+
+sub bench_instance_name {
+    my ($i) = @_;
+    return sprintf( "tenant%04d", $i );
+}
+
+# returns the path of the generated mailpw.conf
+sub generate_bench_fixtures {
+    my %opts = @_;
+
+    my $dir = $opts{dir};
+    make_path($dir);
+
+    # a fixed, well-formed hash; the content is never verified
+    my $hash = '$6$bench.fixture$'
+      . 'oBamM8jgbJcLY0b37N72jEgFkAahssOGbXPFDgXidFG3TYSBZvEDk4FhAxXF418'
+      . 'fyxgyxUvrj00X5qHAxJ18Z.';
+
+    my $conf_path = "$dir/mailpw.conf";
+    open( my $conf, '>', $conf_path ) or die "open '$conf_path' failed. $!";
+    print $conf "# generated by $0\n";
+
+    for my $i ( 0 .. $opts{instances} - 1 ) {
+        my $instance = bench_instance_name($i);
+        make_path("$dir/$instance");
+
+        for my $j ( 0 .. $opts{files} - 1 ) {
+            my $type   = ( $j % 2 ) ? 'passwd' : 'space';
+            my $pwfile = "$dir/$instance/$type-$j";
+
+            open( my $out, '>', $pwfile ) or die "open '$pwfile' failed. $!";
+            for my $u ( 0 .. $opts{users} - 1 ) {
+                my $user = bench_user_name($u);
+                if ( $type eq 'passwd' ) {
+                    my $id = 1000 + $u;
+                    print $out "$user:$hash:${id}:${id}::/home/$user:/bin/sh\n";
+                }
+                else {
+                    print $out "$user\t$hash\n";
+                }
+            }
+            close($out) or die "close '$pwfile' failed. $!";
+
+            print $conf "$instance\t$type\t$pwfile\n";
+        }
+    }
+    close($conf) or die "close '$conf_path' failed. $!";
+
+    return $conf_path;
+}
+
+1;
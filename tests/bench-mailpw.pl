@@ -0,0 +1,146 @@
+#!/usr/bin/env perl
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright (C) 2021 Eric Herman <eric@freesa.org>
+
+# Sweeps password file size and the number of parallel mailpw invocations,
+# reporting latency percentiles, lock-wait time and bytes written:
+#
+#	perl tests/bench-mailpw.pl --users=1000,10000 --parallel=1,4 --runs=5
+#
+# The mailpw() entry point is called directly with a stub hash command,
+# thus no passphrase is prompted for.
+
+use strict;
+use warnings;
+
+use File::Temp qw( tempdir );
+use Getopt::Long;
+use POSIX qw( _exit );
+use Time::HiRes qw( time );
+
+# Load the functions in mailpw and the fixture generator
+do './mailpw';
+do './tests/bench-mailpw-fixtures.pl';
+
+our $mailpw_stats;
+
+my $stub_hash = '$6$bench.stub$'
+  . 'PQFilXtydPMPdJSK0JvL4IyVf1rJXKZIn557aCznpdjSupkcdmBQXroOfmcU2UkN5g'
+  . 'j8wgG8tJ1Bvw5sx0rJm.';
+my $stub_cmd = "echo '$stub_hash'";
+
+my %opts = (
+    users     => '1000,10000,100000,1000000',
+    parallel  => '1,2,4,8',
+    runs      => 5,
+    instances => 2,
+    files     => 2,
+);
+GetOptions(
+    'users=s'     => \$opts{users},
+    'parallel=s'  => \$opts{parallel},
+    'runs=i'      => \$opts{runs},
+    'instances=i' => \$opts{instances},
+    'files=i'     => \$opts{files},
+) or die("bad options\n");
+
+my @user_counts = split( /,/, $opts{users} );
+my @parallels   = split( /,/, $opts{parallel} );
+
+printf( "%9s %8s %5s %10s %10s %10s %10s %14s %12s\n",
+    'users', 'parallel', 'runs', 'p50_ms', 'p90_ms', 'p99_ms', 'max_ms',
+    'lock_wait_ms', 'bytes/run' );
+
+foreach my $users (@user_counts) {
+    my $dir       = tempdir( CLEANUP => 1 );
+    my $conf_path = generate_bench_fixtures(
+        dir       => $dir,
+        instances => $opts{instances},
+        files     => $opts{files},
+        users     => $users,
+    );
+    foreach my $parallel (@parallels) {
+        my @results = bench_parallel( $conf_path, $users, $parallel );
+        report( $users, $parallel, @results );
+    }
+}
+
+exit(0);
+
+# fork $parallel children, each calling mailpw() $opts{runs} times,
+# returns a list of [ latency, lock_wait, bytes_written ] in seconds/bytes
+sub bench_parallel {
+    my ( $conf_path, $users, $parallel ) = @_;
+
+    my @children;
+    for my $child ( 0 .. $parallel - 1 ) {
+        pipe( my $from_child, my $to_parent ) or die "pipe failed. $!";
+        my $pid = fork();
+        die "fork failed. $!" unless defined($pid);
+        if ( $pid == 0 ) {
+            close($from_child);
+            open( STDOUT, '>', '/dev/null' ) or die "no /dev/null? $!";
+            for my $run ( 0 .. $opts{runs} - 1 ) {
+
+                # spread the users over the file
+                my $n = ( $child * $opts{runs} + $run ) * 7919 % $users;
+                local $ENV{SUDO_USER} = bench_user_name($n);
+                local $mailpw_stats = { lock_wait => 0, bytes_written => 0 };
+
+                my $start = time();
+                mailpw( $conf_path, $stub_cmd );
+                my $latency = time() - $start;
+
+                print $to_parent join( ' ',
+                    $latency, $mailpw_stats->{lock_wait},
+                    $mailpw_stats->{bytes_written} ),
+                  "\n";
+            }
+            close($to_parent);
+            _exit(0);
+        }
+        close($to_parent);
+        push( @children, [ $pid, $from_child ] );
+    }
+
+    my @results;
+    foreach my $child (@children) {
+        my ( $pid, $from_child ) = @$child;
+        while ( my $line = <$from_child> ) {
+            push( @results, [ split( ' ', $line ) ] );
+        }
+        close($from_child);
+        waitpid( $pid, 0 );
+        die "child $pid failed: $?" if $?;
+    }
+    return @results;
+}
+
+sub percentile {
+    my ( $pct, @sorted ) = @_;
+    my $rank = int( ( $pct / 100 ) * scalar(@sorted) + 0.5 );
+    $rank = 1              if $rank < 1;
+    $rank = scalar(@sorted) if $rank > scalar(@sorted);
+    return $sorted[ $rank - 1 ];
+}
+
+sub report {
+    my ( $users, $parallel, @results ) = @_;
+
+    my @latencies = sort { $a <=> $b } map { $_->[0] } @results;
+    my ( $lock_wait, $bytes ) = ( 0, 0 );
+    foreach my $result (@results) {
+        $lock_wait += $result->[1];
+        $bytes     += $result->[2];
+    }
+    my $runs = scalar(@results);
+
+    printf( "%9d %8d %5d %10.2f %10.2f %10.2f %10.2f %14.2f %12d\n",
+        $users, $parallel, $runs,
+        1000 * percentile( 50, @latencies ),
+        1000 * percentile( 90, @latencies ),
+        1000 * percentile( 99, @latencies ),
+        1000 * $latencies[-1],
+        1000 * $lock_wait / $runs,
+        $bytes / $runs );
+}
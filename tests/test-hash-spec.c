@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/* test-hash-spec.c */
+/* Copyright (C) 2021 Eric Herman <eric@freesa.org> */
+
+#include "pwcrypt.c"
+#include "test-util.c"
+
+unsigned test_parse_hash_spec(void)
+{
+	unsigned failures = 0;
+	struct pwcrypt_spec spec;
+
+	failures += check(parse_hash_spec("SHA512", &spec) == 0, "SHA512");
+	failures += check_str(spec.algorithm, "SHA512", "'%s'", spec.algorithm);
+	failures += check(spec.rounds == 0, "rounds %lu", spec.rounds);
+
+	failures += check(parse_hash_spec("5:10000", &spec) == 0, "5:10000");
+	failures += check_str(spec.algorithm, "5", "'%s'", spec.algorithm);
+	failures += check(spec.rounds == 10000, "rounds %lu", spec.rounds);
+
+	failures += check(parse_hash_spec(NULL, &spec) != 0, "NULL");
+	failures += check(parse_hash_spec("", &spec) != 0, "empty");
+	failures += check(parse_hash_spec(":5000", &spec) != 0, "no algo");
+	failures += check(parse_hash_spec("6:", &spec) != 0, "no rounds");
+	failures += check(parse_hash_spec("6:0", &spec) != 0, "zero rounds");
+	failures += check(parse_hash_spec("6:999", &spec) != 0, "too few");
+	failures += check(parse_hash_spec("6:1000", &spec) == 0, "fewest");
+	failures += check(parse_hash_spec("6:999999999", &spec) == 0, "most");
+	failures += check(parse_hash_spec("6:1000000000", &spec) != 0,
+			  "too many");
+	failures += check(parse_hash_spec("6:12x", &spec) != 0, "12x");
+	failures += check(parse_hash_spec("6:-1", &spec) != 0, "-1");
+
+	return failures;
+}
+
+char *fgets_passphrase(char *s, int size, FILE *stream)
+{
+	(void)stream;
+	strncpy(s, "Love is infinite, time is not.\n", size);
+	return s;
+}
+
+unsigned test_pwcrypt_hashes(void)
+{
+	unsigned failures = 0;
+
+	const size_t tty_buf_size = 2048;
+	char tty_buf[tty_buf_size];
+	memset(tty_buf, 0x00, tty_buf_size);
+	FILE *tty = fmemopen(tty_buf, tty_buf_size, "r+");
+	if (!tty) {
+		err(EXIT_FAILURE, "fmemopen tty_buf");
+	}
+
+	const size_t out_buf_size = 2048;
+	char out_buf[out_buf_size];
+	memset(out_buf, 0x00, out_buf_size);
+	FILE *out = fmemopen(out_buf, out_buf_size, "w");
+	if (!out) {
+		err(EXIT_FAILURE, "fmemopen out_buf");
+	}
+
+	struct pwcrypt_spec specs[3];
+	parse_hash_spec("SHA512", &specs[0]);
+	parse_hash_spec("SHA256:10000", &specs[1]);
+	parse_hash_spec("6:5000", &specs[2]);
+
+	int confirm = 0;
+	int rv = pwcrypt_hashes(out, confirm, "mail", specs, 3, "just.a.pinch",
+				fgets_passphrase, tty);
+	fclose(out);
+	fclose(tty);
+
+	failures += check(rv == 0, "rv: %d", rv);
+
+	const char *expected =
+	    "$6$just.a.pinch$oBamM8jgbJcLY0b37N72jEgFkAahssOGbXPFDgXidFG3TYS"
+	    "BZvEDk4FhAxXF418fyxgyxUvrj00X5qHAxJ18Z.\n"
+	    "$5$rounds=10000$just.a.pinch$"
+	    "QhGcXDA1GYVHjSlX9kHL548UsvOWKDJDNcOEvz8gEH8\n"
+	    "$6$rounds=5000$just.a.pinch$oBamM8jgbJcLY0b37N72jEgFkAahssOGbXPF"
+	    "DgXidFG3TYSBZvEDk4FhAxXF418fyxgyxUvrj00X5qHAxJ18Z.\n";
+	failures += check_str(out_buf, expected, "\n'%s' !=\n'%s'", out_buf,
+			      expected);
+
+	return failures;
+}
+
+unsigned test_crypt_failed(void)
+{
+	unsigned failures = 0;
+	struct crypt_data data;
+
+	failures += check(crypt_failed(NULL), "NULL");
+	failures += check(crypt_failed("*0"), "*0");
+	failures += check(crypt_failed("*1"), "*1");
+	failures += check(!crypt_failed("$1$abc$x"), "MD5");
+
+	/* an unknown algorithm: NULL, or a failure token with libxcrypt */
+	memset(&data, 0x00, sizeof(struct crypt_data));
+	failures += check(crypt_failed(crypt_r("pw", "$x$abc$", &data)),
+			  "unknown algorithm");
+
+	return failures;
+}
+
+int main(void)
+{
+	unsigned failures = 0;
+
+	failures += run_test(test_parse_hash_spec);
+	failures += run_test(test_pwcrypt_hashes);
+	failures += run_test(test_crypt_failed);
+
+	return failures_to_status("test-hash-spec", failures);
+}
@@ -0,0 +1,108 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright (C) 2021 Eric Herman <eric@freesa.org>
+
+use strict;
+use warnings;
+
+use File::Temp qw( tempdir );
+
+our $PLANNED;
+use Test;
+BEGIN { $PLANNED = 18; plan tests => $PLANNED; }
+
+# Load the functions in mailpw
+do './mailpw';
+
+# slurp, spew
+do './tests/test-util.pl' or die "tests/test-util.pl: $@ $!";
+
+my $ok = 0;
+
+# results are in order, whichever worker produced them
+my @items   = ( 1 .. 20 );
+my @squares = run_in_workers( sub { $_[0] * $_[0] }, \@items );
+$ok += ok( join( ',', @squares ), join( ',', map { $_ * $_ } @items ) );
+
+# the worker process is not the parent
+my ($worker_pid) = run_in_workers( sub { $$ }, [ 1, 2 ] );
+$ok += ok( $worker_pid != $$ );
+
+# the first error is reported, including multi-line messages
+my $died = !eval {
+    run_in_workers( sub { die "bad\nitem $_[0]\n" if $_[0] > 2; 1 }, \@items );
+    1;
+};
+$ok += ok($died);
+$ok += ok( $@, "bad\nitem 3\n" );
+
+my $dir = tempdir( CLEANUP => 1 );
+mkdir("$dir/a") or die $!;
+mkdir("$dir/b") or die $!;
+
+my $old_hash = '$1$I.amFrij$h8Orif34zr5liFE1ck9Js/';
+my $new_hash = '$6$just.a.pinch$oBamM8jgbJcLY0b37N72jEgFkAahssOGbX';
+my @pwfiles  = ( "$dir/a/users", "$dir/b/users", "$dir/b/passwd" );
+foreach my $pwfile (@pwfiles) {
+    open( my $fh, '>', $pwfile ) or die "$pwfile: $!";
+    if ( $pwfile =~ /passwd/ ) {
+        print $fh "ada:$old_hash:1001:1001::/home/ada:/bin/sh\n";
+    }
+    else {
+        print $fh "ada $old_hash\n";
+    }
+    close($fh);
+    chmod( 0640, $pwfile ) or die "chmod $pwfile: $!";
+}
+
+sub jobs_for {
+    return map {
+        {
+            pwfile => $_,
+            delim  => delim_for_type( /passwd/ ? 'passwd' : 'space' ),
+            hash   => $new_hash,
+        }
+    } @_;
+}
+
+# if any file can not be written, none are replaced, and no temporary
+# files are left behind
+$died = !eval {
+    commit_pwfiles( 'ada', [ jobs_for( @pwfiles, "$dir/b/missing" ) ] );
+    1;
+};
+$ok += ok($died);
+$ok += ok( index( $@, "$dir/b/missing" ) >= 0 );
+$ok += ok( slurp("$dir/a/users"), "ada $old_hash\n" );
+$ok += ok( slurp("$dir/b/users"), "ada $old_hash\n" );
+my @left = glob("$dir/*/mailpw-*");
+$ok += ok( scalar(@left), 0 );
+
+commit_pwfiles( 'ada', [ jobs_for(@pwfiles) ] );
+$ok += ok( slurp("$dir/a/users"),  "ada $new_hash\n" );
+$ok += ok( slurp("$dir/b/users"),  "ada $new_hash\n" );
+$ok += ok( slurp("$dir/b/passwd"), "ada:$new_hash:1001:1001::/home/ada:/bin/sh\n" );
+$ok += ok( slurp("$dir/b/users.old"), "ada $old_hash\n" );
+$ok += ok( sprintf( "%04o", ( stat("$dir/b/passwd") )[2] & 07777 ), '0640' );
+
+# if a file can not be replaced, the new files not yet moved into place
+# are not left behind
+unlink("$dir/b/users.old") or die $!;
+mkdir("$dir/b/users.old")  or die $!;
+$died = !eval {
+    commit_pwfiles( 'ada', [ jobs_for(@pwfiles) ] );
+    1;
+};
+$ok += ok($died);
+$ok += ok( index( $@, "$dir/b/users.old" ) >= 0 );
+@left = glob("$dir/*/mailpw-*");
+$ok += ok( scalar(@left), 0 );
+
+# many files are written by forked workers
+mkdir("$dir/c") or die $!;
+my @many = map { "$dir/c/users$_" } ( 1 .. min_files_for_commit_workers() );
+spew( $_, "ada $old_hash\n" ) for (@many);
+commit_pwfiles( 'ada', [ jobs_for(@many) ] );
+my $replaced = grep { slurp($_) eq "ada $new_hash\n" } @many;
+$ok += ok( $replaced, scalar(@many) );
+
+exit( $ok == $PLANNED ? 0 : 1 );
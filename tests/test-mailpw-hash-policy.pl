@@ -0,0 +1,150 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright (C) 2021 Eric Herman <eric@freesa.org>
+
+use strict;
+use warnings;
+
+use File::Temp qw( tempdir tempfile );
+
+our $PLANNED;
+use Test;
+BEGIN { $PLANNED = 21; plan tests => $PLANNED; }
+
+# Load the functions in mailpw
+do './mailpw';
+
+# slurp, spew
+do './tests/test-util.pl' or die "tests/test-util.pl: $@ $!";
+
+my $dir = tempdir( CLEANUP => 1 );
+
+# a stand-in for "pwcrypt" which outputs a fake hash per each --hash SPEC,
+# with the algorithm as the hashed part, and records how often it was run
+open( my $stub, '>', "$dir/fake-pwcrypt" ) or die "$dir/fake-pwcrypt: $!";
+print $stub <<"EOF";
+#!/bin/sh
+echo run >> "$dir/runs"
+echo "a line which is not a hash"
+for ARG in "\$@"; do
+	case "\$ARG" in
+	--hash=*)
+		SPEC="\${ARG#--hash=}"
+		ALGO="\${SPEC%%:*}"
+		case "\$ALGO" in SHA256) ID=5 ;; *) ID=6 ;; esac
+		case "\$SPEC" in
+		*:*) echo "\\\$\$ID\\\$rounds=\${SPEC#*:}\\\$fake\\\$\$ALGO" ;;
+		*) echo "\\\$\$ID\\\$fake\\\$\$ALGO" ;;
+		esac
+		;;
+	esac
+done
+EOF
+close($stub);
+chmod( 0755, "$dir/fake-pwcrypt" ) or die "chmod $dir/fake-pwcrypt: $!";
+
+# as pwcrypt would, had crypt_r failed
+open( $stub, '>', "$dir/failing-pwcrypt" ) or die "$dir/failing-pwcrypt: $!";
+print $stub <<"EOF";
+#!/bin/sh
+for ARG in "\$@"; do echo '*0'; done
+EOF
+close($stub);
+chmod( 0755, "$dir/failing-pwcrypt" ) or die "chmod $dir/failing-pwcrypt: $!";
+
+my $old_hash = '$1$I.amFrij$h8Orif34zr5liFE1ck9Js/';
+
+my %files = (
+    foo_pw => "$dir/foo-passwd",
+    foo_sp => "$dir/foo-users",
+    bar_sp => "$dir/bar-users",
+);
+foreach my $path ( values %files ) {
+    open( my $fh, '>', $path ) or die "$path: $!";
+    if ( $path =~ /passwd/ ) {
+        print $fh "ada:$old_hash:1001:1001::/home/ada:/bin/sh\n";
+        print $fh "brian:$old_hash:1002:1002::/home/brian:/bin/sh\n";
+    }
+    else {
+        print $fh "ada $old_hash\nbrian $old_hash\n";
+    }
+    close($fh);
+}
+
+my ( $conf_fh, $conf_path ) =
+  tempfile( "test-mailpw-XXXXXX", DIR => $dir, UNLINK => 0, SUFFIX => ".conf" );
+print $conf_fh <<"EOF";
+foo passwd $files{foo_pw} algorithm=SHA256 rounds=10000
+foo space  $files{foo_sp}
+bar space  $files{bar_sp} rounds=656000
+EOF
+close($conf_fh);
+
+my $ok = 0;
+
+my $instances = read_mailpw_config($conf_path);
+$ok += ok( hash_policy( $instances->{foo}->{ $files{foo_pw} } ),
+    'SHA256:10000' );
+$ok += ok( hash_policy( $instances->{foo}->{ $files{foo_sp} } ), 'default' );
+$ok += ok( hash_policy( $instances->{bar}->{ $files{bar_sp} } ),
+    'default:656000' );
+
+$ok += ok( !eval { parse_config_text("x space /y rounds=many\n"); 1 } );
+$ok += ok( !eval { parse_config_text("x space /y rounds=500\n"); 1 } );
+$ok += ok( !eval { parse_config_text("x space /y rounds=1000000000\n"); 1 } );
+$ok += ok( eval { parse_config_text("x space /y rounds=1000\n"); 1 } );
+$ok += ok( !eval { parse_config_text("x space /y colour=blue\n"); 1 } );
+
+# a single default policy does not add --hash options
+$ok += ok( generate_hash("$dir/fake-pwcrypt"), 'a line which is not a hash' );
+
+my @hashes =
+  generate_hashes( [ 'SHA256:10000', 'default' ], "$dir/fake-pwcrypt" );
+$ok += ok( scalar(@hashes), 2 );
+$ok += ok( $hashes[0],      '$5$rounds=10000$fake$SHA256' );
+$ok += ok( $hashes[1],      '$6$fake$default' );
+
+# a failure token is not written as the hash
+my $before = slurp( $files{foo_pw} );
+my $outstr = '';
+open( my $fakeout, '>', \$outstr ) or die "Can't open local string? $!";
+$ok += ok(
+    !eval {
+        change_instance_passwds( $fakeout, 'brian', $conf_path,
+            "$dir/failing-pwcrypt" );
+        1;
+    }
+);
+close($fakeout);
+$ok += ok( $@ =~ /^not a '[^']+' hash: '\*0', nothing changed$/ );
+$ok += ok( slurp( $files{foo_pw} ), $before );
+
+unlink("$dir/runs");
+$outstr = '';
+open( $fakeout, '>', \$outstr ) or die "Can't open local string? $!";
+change_instance_passwds( $fakeout, 'brian', $conf_path, "$dir/fake-pwcrypt" );
+close($fakeout);
+
+# one passphrase prompt, three hashes
+$ok += ok( slurp("$dir/runs"), "run\n" );
+
+$ok += ok(
+    index( slurp( $files{foo_pw} ), 'brian:$5$rounds=10000$fake$SHA256:' ) >=
+      0 );
+$ok +=
+  ok( index( slurp( $files{foo_sp} ), "brian \$6\$fake\$default\n" ) >= 0 );
+$ok += ok(
+    index( slurp( $files{bar_sp} ),
+        "brian \$6\$rounds=656000\$fake\$default\n" ) >= 0
+);
+$ok += ok( index( slurp( $files{foo_sp} ), "ada $old_hash\n" ) >= 0 );
+$ok += ok( index( slurp( $files{bar_sp} ), "ada $old_hash\n" ) >= 0 );
+
+exit( $ok == $PLANNED ? 0 : 1 );
+
+sub parse_config_text {
+    my ($text) = @_;
+    open( my $fh, '<', \$text ) or die "Can't open local string? $!";
+    my $instances = parse_mailpw_config($fh);
+    close($fh);
+    return $instances;
+}
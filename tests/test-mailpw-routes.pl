@@ -0,0 +1,190 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright (C) 2021 Eric Herman <eric@freesa.org>
+
+use strict;
+use warnings;
+
+use File::Temp qw( tempdir );
+
+our $PLANNED;
+use Test;
+BEGIN { $PLANNED = 44; plan tests => $PLANNED; }
+
+# Load the functions in mailpw-admin (which loads mailpw)
+do './mailpw-admin';
+
+# slurp, spew
+do './tests/test-util.pl' or die "tests/test-util.pl: $@ $!";
+
+sub inode {
+    my ($path) = @_;
+    return ( stat($path) )[1];
+}
+
+my $ok = 0;
+
+# binary search
+my $dir = tempdir( CLEANUP => 1 );
+my @keys = qw( ab abc b bb c d e f g h i j k l m n o p q r s t u v w x y z );
+spew( "$dir/sorted", join( '', map { "$_:x\n" } @keys ) );
+open( my $sorted, '<', "$dir/sorted" ) or die $!;
+my $all_found = 1;
+foreach my $key (@keys) {
+    my $line = bsearch_sorted_file( $sorted, $key, ':' );
+    $all_found = 0 unless ( defined($line) && $line eq "$key:x\n" );
+}
+$ok += ok($all_found);
+$ok += ok( !defined( bsearch_sorted_file( $sorted, 'a',   ':' ) ) );
+$ok += ok( !defined( bsearch_sorted_file( $sorted, 'abd', ':' ) ) );
+$ok += ok( !defined( bsearch_sorted_file( $sorted, 'ba',  ':' ) ) );
+$ok += ok( !defined( bsearch_sorted_file( $sorted, 'zz',  ':' ) ) );
+close($sorted);
+
+spew( "$dir/empty", '' );
+open( my $empty, '<', "$dir/empty" ) or die $!;
+$ok += ok( !defined( bsearch_sorted_file( $empty, 'a', ':' ) ) );
+close($empty);
+
+# includes and the routing map
+my $old_hash = '$1$I.amFrij$h8Orif34zr5liFE1ck9Js/';
+my $new_hash = '$6$just.a.pinch$oBamM8jgbJcLY0b37N72jEgFkAahssOGbX';
+
+mkdir("$dir/conf.d") or die $!;
+mkdir("$dir/qux")    or die $!;
+spew( "$dir/foo-users",  "ada $old_hash\nbrian $old_hash\n" );
+spew( "$dir/foo-passwd", "ada:$old_hash:1001:1001::/:/bin/sh\n" );
+spew( "$dir/bar-users",  "brian $old_hash\ncarol $old_hash\n" );
+spew( "$dir/baz-users",  "don $old_hash\n" );
+spew( "$dir/qux/0-of-1", "brian $old_hash\n" );
+
+my $conf_path = "$dir/mailpw.conf";
+spew( $conf_path, <<"EOF" );
+routes $dir/routes
+include $dir/conf.d/*.conf
+baz space $dir/baz-users
+EOF
+spew( "$dir/conf.d/a.conf", <<"EOF" );
+foo space  $dir/foo-users
+foo passwd $dir/foo-passwd
+EOF
+spew( "$dir/conf.d/b.conf", <<"EOF" );
+bar space $dir/bar-users
+qux space $dir/qux shards=1
+EOF
+
+my $config    = {};
+my $instances = read_mailpw_config( $conf_path, $config );
+$ok += ok( join( ',', sort keys %$instances ), 'bar,baz,foo,qux' );
+$ok += ok( scalar( @{ $config->{sources} } ), 3 );
+$ok += ok( $config->{routes}, "$dir/routes" );
+$ok += ok( $instances->{foo}->{"$dir/foo-users"}->{source},
+    "$dir/conf.d/a.conf" );
+
+my ( $user_instances, $routes );
+( $instances, $user_instances, $routes ) =
+  load_user_instances( 'brian', $conf_path );
+$ok += ok( $routes, "$dir/routes" );
+$ok += ok( join( ',', sort @$user_instances ), 'bar,foo,qux' );
+$ok += ok( join( ',', sort keys %$instances ), 'bar,foo,qux' );
+$ok += ok( scalar( keys %{ $instances->{foo} } ), 2 );
+$ok += ok( slurp("$dir/routes"),
+    "ada\tfoo\nbrian\tbar foo qux\ncarol\tbar\ndon\tbaz\n" );
+
+( undef, $user_instances ) = load_user_instances( 'nobody', $conf_path );
+$ok += ok( scalar(@$user_instances), 0 );
+
+# the map is reused while nothing changes
+my $routes_inode = inode("$dir/routes");
+( $instances, $user_instances ) = load_user_instances( 'don', $conf_path );
+$ok += ok( inode("$dir/routes"), $routes_inode );
+$ok += ok( join( ',', keys %$instances ), 'baz' );
+
+# changing a hash keeps the map valid
+my $outstr = '';
+open( my $fakeout, '>', \$outstr ) or die "Can't open local string? $!";
+change_instance_passwds( $fakeout, 'brian', $conf_path, "echo '$new_hash'" );
+close($fakeout);
+$ok += ok( index( slurp("$dir/bar-users"), "brian $new_hash\n" ) >= 0 );
+$ok += ok( index( slurp("$dir/qux/0-of-1"), "brian $new_hash\n" ) >= 0 );
+$ok += ok( inode("$dir/routes"), $routes_inode );
+$ok += ok( defined( read_routes_sources("$dir/routes") ) );
+
+# a user no longer in a routed instance makes the map stale
+spew( "$dir/bar-users", "carol $old_hash\n" );
+( undef, $user_instances ) = load_user_instances( 'brian', $conf_path );
+$ok += ok( join( ',', sort @$user_instances ), 'foo,qux' );
+$ok += ok( inode("$dir/routes") != $routes_inode );
+
+# a user added by hand is seen once the map is rebuilt
+spew( "$dir/baz-users", "don $old_hash\nbrian $old_hash\n" );
+( undef, $user_instances ) = load_user_instances( 'brian', $conf_path );
+$ok += ok( join( ',', sort @$user_instances ), 'foo,qux' );
+$ok += ok( mailpw_admin( "--conf=$conf_path", 'routes' ), 0 );
+( undef, $user_instances ) = load_user_instances( 'brian', $conf_path );
+$ok += ok( join( ',', sort @$user_instances ), 'baz,foo,qux' );
+
+# as is a user the map does not have, without a rebuild by hand
+spew( "$dir/baz-users", "don $old_hash\nbrian $old_hash\nerin $old_hash\n" );
+( undef, $user_instances ) = load_user_instances( 'erin', $conf_path );
+$ok += ok( join( ',', @$user_instances ), 'baz' );
+
+# a user in no instance is told so, and is not asked for a passphrase
+$outstr = '';
+open( $fakeout, '>', \$outstr ) or die "Can't open local string? $!";
+$ok += ok( change_instance_passwds( $fakeout, 'nobody', $conf_path, 'false' ),
+    0 );
+close($fakeout);
+$ok += ok( $outstr, "nobody has no password in $conf_path\n" );
+
+# a rewrite of a configuration file makes it stale, even of the same size
+# within the same second
+spew( "$dir/conf.d/b.conf", <<"EOF" );
+qux space $dir/qux shards=1
+bar space $dir/bar-users
+EOF
+$ok += ok( !defined( read_routes_sources("$dir/routes") ) );
+
+# as does a new included file
+spew( "$dir/conf.d/c.conf", "ember space $dir/baz-users\n" );
+$ok += ok( !defined( read_routes_sources("$dir/routes") ) );
+( undef, $user_instances ) = load_user_instances( 'don', $conf_path );
+$ok += ok( join( ',', sort @$user_instances ), 'baz,ember' );
+
+# resharding an included entry updates the included file
+reshard( $conf_path, 'qux', "$dir/qux", 2 );
+$ok += ok( index( slurp("$dir/conf.d/b.conf"), "shards=2" ) >= 0 );
+$ok += ok( index( slurp($conf_path), "shards" ) < 0 );
+( $instances, $user_instances ) = load_user_instances( 'brian', $conf_path );
+$ok += ok( $instances->{qux}->{"$dir/qux"}->{shards}, 2 );
+
+# mailpw-admin can rebuild the map
+unlink("$dir/routes.sources") or die $!;
+$ok += ok( mailpw_admin( "--conf=$conf_path", 'routes' ), 0 );
+$ok += ok( defined( read_routes_sources("$dir/routes") ) );
+
+# a rebuild keeps the owner, group and mode of the map, e.g.: for mailpw
+# run as the mail user after "mailpw-admin routes" as root
+my ( $uid, $gid ) = ( $> == 0 ) ? ( 12345, 12346 ) : ( $>, $) + 0 );
+foreach my $path ( "$dir/routes", "$dir/routes.sources" ) {
+    chown( $uid, $gid, $path ) or die "chown $path: $!";
+    chmod( 0640, $path ) or die "chmod $path: $!";
+}
+$ok += ok( mailpw_admin( "--conf=$conf_path", 'routes' ), 0 );
+foreach my $path ( "$dir/routes", "$dir/routes.sources" ) {
+    my ( undef, undef, $mode, undef, $new_uid, $new_gid ) = stat($path);
+    $ok += ok( sprintf( '%d:%d %04o', $new_uid, $new_gid, $mode & 07777 ),
+        "$uid:$gid 0640" );
+}
+
+# users added by mailpw-admin are in the map at once
+spew( "$dir/fred-users",    '' );
+spew( "$dir/conf.d/d.conf", "fred space $dir/fred-users sorted\n" );
+$ok += ok( mailpw_admin( "--conf=$conf_path", 'routes' ), 0 );
+my $batch = "gus $old_hash\n";
+open( my $batch_fh, '<', \$batch ) or die "Can't open local string? $!";
+bulk_change( $conf_path, 'add', 'fred', "$dir/fred-users", $batch_fh );
+$ok += ok( defined( read_routes_sources("$dir/routes") ) );
+( undef, $user_instances ) = load_user_instances( 'gus', $conf_path );
+$ok += ok( join( ',', @$user_instances ), 'fred' );
+
+exit( $ok == $PLANNED ? 0 : 1 );
@@ -0,0 +1,162 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright (C) 2021 Eric Herman <eric@freesa.org>
+
+use strict;
+use warnings;
+
+use Fcntl qw( :flock );
+use File::Temp qw( tempdir tempfile );
+
+our $PLANNED;
+use Test;
+BEGIN { $PLANNED = 29; plan tests => $PLANNED; }
+
+# Load the functions in mailpw-admin (which loads mailpw)
+do './mailpw-admin';
+
+# slurp, spew
+do './tests/test-util.pl' or die "tests/test-util.pl: $@ $!";
+
+sub count_lines {
+    my ($path) = @_;
+    my @lines = split( /\n/, slurp($path) );
+    return scalar(@lines);
+}
+
+my $ok = 0;
+
+# known FNV-1a values
+$ok += ok( fnv1a32(''),       0x811c9dc5 );
+$ok += ok( fnv1a32('a'),      0xe40c292c );
+$ok += ok( fnv1a32('foobar'), 0xbf9cf968 );
+
+$ok += ok( shard_for_user( 'anyone', 1 ), 0 );
+$ok += ok( shard_path( '/x/users', 3, 16 ), '/x/users/3-of-16' );
+
+my $dir = tempdir( CLEANUP => 1 );
+mkdir("$dir/users") or die "mkdir $dir/users: $!";
+mkdir("$dir/passwd") or die "mkdir $dir/passwd: $!";
+
+my $old_hash = '$1$I.amFrij$h8Orif34zr5liFE1ck9Js/';
+my @users    = map { "user$_" } ( 1 .. 40 );
+
+open( my $sp, '>', "$dir/users/0-of-1" ) or die $!;
+open( my $pw, '>', "$dir/passwd/0-of-1" ) or die $!;
+foreach my $user (@users) {
+    print $sp "$user $old_hash\n";
+    print $pw "$user:$old_hash:1001:1001::/home/$user:/bin/sh\n";
+}
+close($sp);
+close($pw);
+
+my ( $conf_fh, $conf_path ) =
+  tempfile( "test-mailpw-XXXXXX", DIR => $dir, UNLINK => 0, SUFFIX => ".conf" );
+print $conf_fh <<"EOF";
+# sharded
+foo\tspace\t$dir/users\tshards=1
+foo\tpasswd\t$dir/passwd shards=1 # comment
+EOF
+close($conf_fh);
+
+my $instances = read_mailpw_config($conf_path);
+$ok += ok( $instances->{foo}->{"$dir/users"}->{shards}, 1 );
+$ok += ok( $instances->{foo}->{"$dir/passwd"}->{type},  'passwd' );
+
+# split
+reshard( $conf_path, 'foo', "$dir/users", 4 );
+reshard( $conf_path, 'foo', "$dir/passwd", 4 );
+
+$ok += ok( !-e "$dir/users/0-of-1" );
+$instances = read_mailpw_config($conf_path);
+$ok += ok( $instances->{foo}->{"$dir/users"}->{shards},  4 );
+$ok += ok( $instances->{foo}->{"$dir/passwd"}->{shards}, 4 );
+$ok += ok( index( slurp($conf_path), "# comment" ) >= 0 );
+
+my $total     = 0;
+my $misplaced = 0;
+for my $shard ( 0 .. 3 ) {
+    my $path = shard_path( "$dir/users", $shard, 4 );
+    foreach my $line ( split( /\n/, slurp($path) ) ) {
+        my ($user) = split( /\s/, $line );
+        ++$total;
+        ++$misplaced if ( shard_for_user( $user, 4 ) != $shard );
+    }
+}
+$ok += ok( $total,     scalar(@users) );
+$ok += ok( $misplaced, 0 );
+
+# the user is only looked for in, and changed in, one shard
+my $user       = 'user7';
+my $shard      = shard_for_user( $user, 4 );
+my $user_shard = shard_path( "$dir/users", $shard, 4 );
+my $other_shard = shard_path( "$dir/users", ( $shard + 1 ) % 4, 4 );
+
+my $user_instances = find_instances_for_user( $user, $instances );
+$ok += ok( scalar(@$user_instances), 1 );
+$ok += ok( $user_instances->[0],     'foo' );
+
+my $other_before = slurp($other_shard);
+
+my $new_hash =
+'$6$just.a.pinch$oBamM8jgbJcLY0b37N72jEgFkAahssOGbXPFDgXidFG3TYSBZvEDk4FhAxXF418fyxgyxUvrj00X5qHAxJ18Z.';
+my $outstr = '';
+open( my $fakeout, '>', \$outstr ) or die "Can't open local string? $!";
+change_instance_passwds( $fakeout, $user, $conf_path, "echo '$new_hash'" );
+close($fakeout);
+
+$ok += ok( index( slurp($user_shard), "$user $new_hash\n" ) >= 0 );
+$ok += ok(
+    index( slurp( shard_path( "$dir/passwd", $shard, 4 ) ),
+        "$user:$new_hash:" ) >= 0
+);
+$ok += ok( slurp($other_shard), $other_before );
+$ok += ok( -e "$user_shard.old" );
+$ok += ok( !-e "$other_shard.old" );
+
+# merge
+reshard( $conf_path, 'foo', "$dir/users", 2 );
+$instances = read_mailpw_config($conf_path);
+$ok += ok( $instances->{foo}->{"$dir/users"}->{shards},  2 );
+$ok += ok( $instances->{foo}->{"$dir/passwd"}->{shards}, 4 );
+$ok += ok( !-e "$user_shard.old" );
+
+$total = 0;
+for my $shard ( 0 .. 1 ) {
+    $total += count_lines( shard_path( "$dir/users", $shard, 2 ) );
+}
+$ok += ok( $total, scalar(@users) );
+
+my $merged = slurp( shard_path( "$dir/users", shard_for_user( $user, 2 ), 2 ) );
+$ok += ok( index( $merged, "$user $new_hash\n" ) >= 0 );
+
+$ok += ok( !eval { reshard( $conf_path, 'foo', "$dir/users", 2 ); 1 } );
+$ok += ok( !eval { reshard( $conf_path, 'bar', "$dir/users", 3 ); 1 } );
+
+# while mailpw.conf is locked, as by a reshard in progress, it may be half
+# written; the lookup waits for the lock rather than reading it
+my $conf_before = slurp($conf_path);
+pipe( my $from_child, my $to_parent ) or die "pipe: $!";
+my $pid = fork() // die "fork: $!";
+if ( $pid == 0 ) {
+    close($from_child);
+    open( my $fh_lock, '+<', $conf_path ) or die $!;
+    flock( $fh_lock, LOCK_EX ) or die $!;
+    truncate( $fh_lock, 0 ) or die $!;
+    print $fh_lock "foo\n";
+    close($to_parent);
+    sleep(1);
+    truncate( $fh_lock, 0 ) or die $!;
+    seek( $fh_lock, 0, 0 ) or die $!;
+    print $fh_lock $conf_before;
+    close($fh_lock);
+    exit(0);
+}
+close($to_parent);
+<$from_child>;    # EOF once the child holds the lock
+my ( undef, $locked_user_instances ) =
+  eval { load_user_instances( $user, $conf_path ) };
+$ok += ok( $@, '' );
+$ok += ok( join( ',', @{ $locked_user_instances // [] } ), 'foo' );
+waitpid( $pid, 0 );
+
+exit( $ok == $PLANNED ? 0 : 1 );
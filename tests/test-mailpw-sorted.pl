@@ -0,0 +1,156 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright (C) 2021 Eric Herman <eric@freesa.org>
+
+use strict;
+use warnings;
+
+use File::Temp qw( tempdir tempfile );
+
+our $PLANNED;
+use Test;
+BEGIN { $PLANNED = 27; plan tests => $PLANNED; }
+
+# Load the functions in mailpw-admin (which loads mailpw)
+do './mailpw-admin';
+
+# slurp, spew
+do './tests/test-util.pl' or die "tests/test-util.pl: $@ $!";
+
+sub is_sorted {
+    my ($path) = @_;
+    my @users = map { ( split( /[\s:]/, $_ ) )[0] } split( /\n/, slurp($path) );
+    return join( ',', @users ) eq join( ',', sort @users );
+}
+
+sub batch {
+    my ($contents) = @_;
+    open( my $fh, '<', \$contents ) or die "Can't open local string? $!";
+    return $fh;
+}
+
+sub dir_entries {
+    my ($dir) = @_;
+    opendir( my $dh, $dir ) or die "opendir $dir: $!";
+    my @entries = sort grep { !/^\./ } readdir($dh);
+    closedir($dh);
+    return join( ' ', @entries );
+}
+
+my $ok = 0;
+
+my $dir = tempdir( CLEANUP => 1 );
+mkdir("$dir/sharded") or die "mkdir $dir/sharded: $!";
+
+my $old_hash = '$1$I.amFrij$h8Orif34zr5liFE1ck9Js/';
+spew( "$dir/users",  "carol $old_hash\nada $old_hash\nbob $old_hash\n" );
+spew( "$dir/passwd", "bob:$old_hash:1001:1001::/home/bob:/bin/sh\n" );
+spew( "$dir/plain",  "dan $old_hash\n" );
+spew( shard_path( "$dir/sharded", $_, 3 ), '' ) for ( 0 .. 2 );
+
+my ( $conf_fh, $conf_path ) =
+  tempfile( "test-mailpw-XXXXXX", DIR => $dir, UNLINK => 0, SUFFIX => ".conf" );
+print $conf_fh <<"EOF";
+foo space $dir/users sorted
+foo passwd $dir/passwd /bin/true sorted
+bar space $dir/plain
+bar space $dir/sharded shards=3 sorted
+EOF
+close($conf_fh);
+
+my $instances = read_mailpw_config($conf_path);
+$ok += ok( $instances->{foo}->{"$dir/users"}->{sorted}, 1 );
+$ok += ok( !defined( $instances->{foo}->{"$dir/users"}->{reload} ) );
+$ok += ok( $instances->{foo}->{"$dir/passwd"}->{reload}, '/bin/true' );
+$ok += ok( !$instances->{bar}->{"$dir/plain"}->{sorted} );
+
+# sorting an entry
+sort_entry( $conf_path, 'foo', "$dir/users" );
+$ok += ok( slurp("$dir/users"),
+    "ada $old_hash\nbob $old_hash\ncarol $old_hash\n" );
+$ok += ok( -e "$dir/users.old" );
+
+# a merged batch of additions, in any order
+my $new_hash = '$6$just.a.pinch$oBamM8jgbJcLY0b37N72jEgFkAahssOGbX';
+bulk_change( $conf_path, 'add', 'foo', "$dir/users",
+    batch("zed $new_hash\n\naaron $new_hash\nbea $new_hash\n") );
+$ok += ok( slurp("$dir/users"),
+        "aaron $new_hash\nada $old_hash\nbea $new_hash\n"
+      . "bob $old_hash\ncarol $old_hash\nzed $new_hash\n" );
+
+bulk_change( $conf_path, 'add', 'foo', "$dir/passwd",
+    batch("al:$new_hash:1002:1002::/home/al:/bin/sh\n") );
+$ok += ok( slurp("$dir/passwd"),
+        "al:$new_hash:1002:1002::/home/al:/bin/sh\n"
+      . "bob:$old_hash:1001:1001::/home/bob:/bin/sh\n" );
+
+# the lookup of sorted files is a binary search
+foreach my $user (qw( aaron ada bea bob carol zed )) {
+    my $user_instances = find_instances_for_user( $user, $instances );
+    $ok += ok( join( ',', @$user_instances ), 'foo' );
+}
+$ok += ok( scalar( @{ find_instances_for_user( 'bo', $instances ) } ), 0 );
+$ok += ok( scalar( @{ find_instances_for_user( 'zz', $instances ) } ), 0 );
+
+# an existing user can not be added, nor a missing one removed, and the
+# files are then unchanged, with no temporary files left behind
+my $before  = slurp("$dir/users");
+my $entries = dir_entries($dir);
+$ok += ok(
+    !eval {
+        bulk_change( $conf_path, 'add', 'foo', "$dir/users",
+            batch("new $new_hash\nbob $new_hash\n") );
+        1;
+    }
+);
+$ok += ok( $@, "'bob' is already in $dir/users\n" );
+$ok += ok(
+    !eval {
+        bulk_change( $conf_path, 'remove', 'foo', "$dir/users",
+            batch("ada\nnobody\n") );
+        1;
+    }
+);
+$ok += ok( $@, "'nobody' is not in $dir/users\n" );
+$ok += ok( slurp("$dir/users"), $before );
+$ok += ok( dir_entries($dir),   $entries );
+
+# only sorted entries
+$ok += ok(
+    !eval {
+        bulk_change( $conf_path, 'add', 'bar', "$dir/plain",
+            batch("new $new_hash\n") );
+        1;
+    }
+);
+
+bulk_change( $conf_path, 'remove', 'foo', "$dir/users",
+    batch("zed\naaron\nbob\n") );
+$ok += ok( slurp("$dir/users"),
+    "ada $old_hash\nbea $new_hash\ncarol $old_hash\n" );
+
+# sharded, the batch is split among the shards, each stays sorted
+my @users = map { "user$_" } ( 1 .. 30 );
+bulk_change( $conf_path, 'add', 'bar', "$dir/sharded",
+    batch( join( '', map { "$_ $new_hash\n" } reverse @users ) ) );
+my $misplaced = 0;
+my $unsorted  = 0;
+for my $shard ( 0 .. 2 ) {
+    my $path = shard_path( "$dir/sharded", $shard, 3 );
+    ++$unsorted unless is_sorted($path);
+    foreach my $line ( split( /\n/, slurp($path) ) ) {
+        my ($user) = split( /\s/, $line );
+        ++$misplaced if ( shard_for_user( $user, 3 ) != $shard );
+    }
+}
+$ok += ok( $misplaced, 0 );
+$ok += ok( $unsorted,  0 );
+
+# merging shards keeps them sorted
+reshard( $conf_path, 'bar', "$dir/sharded", 2 );
+$unsorted = 0;
+for my $shard ( 0 .. 1 ) {
+    ++$unsorted unless is_sorted( shard_path( "$dir/sharded", $shard, 2 ) );
+}
+$ok += ok( $unsorted, 0 );
+
+exit( $ok == $PLANNED ? 0 : 1 );
@@ -0,0 +1,110 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright (C) 2021 Eric Herman <eric@freesa.org>
+
+use strict;
+use warnings;
+
+use File::Temp qw( tempdir tempfile );
+use Time::HiRes qw( time );
+
+our $PLANNED;
+use Test;
+BEGIN { $PLANNED = 13; plan tests => $PLANNED; }
+
+# count the processes started by the mailpw functions: these overrides
+# must be in place before mailpw is compiled
+our $spawned = 0;
+
+BEGIN {
+    *CORE::GLOBAL::fork = sub { ++$spawned; return CORE::fork(); };
+    *CORE::GLOBAL::system =
+      sub { ++$spawned; return CORE::system(@_); };
+    *CORE::GLOBAL::readpipe =
+      sub { ++$spawned; return CORE::readpipe( $_[0] ); };
+}
+
+# Load the functions in mailpw
+do './mailpw';
+
+# slurp, spew
+do './tests/test-util.pl' or die "tests/test-util.pl: $@ $!";
+
+# a stand-in for "pwcrypt" which writes the hash to the --output-fd
+my $dir  = tempdir( CLEANUP => 1 );
+my $hash = '$6$just.a.pinch$oBamM8jgbJcLY0b37N72jEgFkAahssOGbXPFDgXidFG3TYS'
+  . 'BZvEDk4FhAxXF418fyxgyxUvrj00X5qHAxJ18Z.';
+open( my $stub, '>', "$dir/pwcrypt" ) or die "$dir/pwcrypt: $!";
+print $stub <<"EOF";
+#!/bin/sh
+for ARG in "\$@"; do
+	case "\$ARG" in
+	--output-fd=*) FD="\${ARG#--output-fd=}" ;;
+	esac
+done
+echo '$hash' >&"\$FD"
+EOF
+close($stub);
+chmod( 0755, "$dir/pwcrypt" ) or die "chmod $dir/pwcrypt: $!";
+local $ENV{PATH} = "$dir:$ENV{PATH}";
+
+my $ok = 0;
+
+my $expected_user = getpwuid($<);
+
+my $start = time();
+{
+    local $ENV{SUDO_USER};
+    local $ENV{SUDO_UID};
+    $spawned = 0;
+    $ok += ok( who_am_i(), $expected_user );
+    $ok += ok( $spawned,   0 );
+}
+
+{
+    local $ENV{SUDO_USER};
+    local $ENV{SUDO_UID} = $<;
+    $spawned = 0;
+    $ok += ok( who_am_i(), $expected_user );
+    $ok += ok( $spawned,   0 );
+}
+
+# only "pwcrypt" itself, no "/bin/sh" and no "tail"
+$spawned = 0;
+$ok += ok( generate_hash(), $hash );
+$ok += ok( $spawned,        1 );
+my $elapsed = time() - $start;
+print "# startup: ", sprintf( "%.2f", 1000 * $elapsed ), " ms\n";
+
+$ok += ok( generate_hash("echo '$hash'"), $hash );
+
+# a whole change, of an instance with two files, starts only "pwcrypt"
+my $old_hash = '$1$I.amFrij$h8Orif34zr5liFE1ck9Js/';
+spew( "$dir/users",  "$expected_user $old_hash\n" );
+spew( "$dir/passwd", "$expected_user:$old_hash:1001:1001::/x:/bin/sh\n" );
+my ( $conf_fh, $conf_path ) =
+  tempfile( "test-mailpw-XXXXXX", DIR => $dir, UNLINK => 0, SUFFIX => ".conf" );
+print $conf_fh "foo space $dir/users\nfoo passwd $dir/passwd\n";
+close($conf_fh);
+
+my $outstr = '';
+open( my $fakeout, '>', \$outstr ) or die "Can't open local string? $!";
+$spawned = 0;
+change_instance_passwds( $fakeout, $expected_user, $conf_path );
+close($fakeout);
+$ok += ok( $spawned, 1 );
+$ok += ok( $outstr, "$expected_user has a password in foo\n" );
+$ok += ok( slurp("$dir/users"), "$expected_user $hash\n" );
+$ok += ok( index( slurp("$dir/passwd"), "$expected_user:$hash:" ), 0 );
+
+# as slow storage may want, the files of any change written concurrently
+spew( $conf_path,
+    "concurrent-writes 2\nfoo space $dir/users\nfoo passwd $dir/passwd\n" );
+spew( "$dir/users", "$expected_user $old_hash\n" );
+open( $fakeout, '>', \$outstr ) or die "Can't open local string? $!";
+$spawned = 0;
+change_instance_passwds( $fakeout, $expected_user, $conf_path );
+close($fakeout);
+$ok += ok( $spawned, 3 );
+$ok += ok( slurp("$dir/users"), "$expected_user $hash\n" );
+
+exit( $ok == $PLANNED ? 0 : 1 );
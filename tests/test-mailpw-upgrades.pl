@@ -0,0 +1,123 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright (C) 2021 Eric Herman <eric@freesa.org>
+
+use strict;
+use warnings;
+
+use File::Temp qw( tempdir tempfile );
+
+our $PLANNED;
+use Test;
+BEGIN { $PLANNED = 33; plan tests => $PLANNED; }
+
+# Load the functions in mailpw-admin (which loads mailpw)
+do './mailpw-admin';
+
+# slurp, spew
+do './tests/test-util.pl' or die "tests/test-util.pl: $@ $!";
+
+my $ok = 0;
+
+my $sha512 = '$6$just.a.pinch$oBamM8jgbJcLY0b37N72jEgFkAahssOGbX';
+my $sha256 = '$5$rounds=10000$just.a.pinch$QhGcXDA1GYVHjSlX9kHL548U';
+my $md5    = '$1$abcdefgh$cHJi5PXp/ki/ktXzqlk6I1';    # "secret"
+
+# the same policy decisions as pwcrypt
+$ok += ok( hash_fits_policy( $sha512, {} ) );
+$ok += ok( hash_fits_policy( $sha512, { algorithm => 'SHA512' } ) );
+$ok += ok( !hash_fits_policy( $sha512, { rounds => 10000 } ) );
+$ok += ok( !hash_fits_policy( $md5, {} ) );
+$ok += ok(
+    hash_fits_policy( $sha256, { algorithm => 'SHA256', rounds => 10000 } ) );
+$ok += ok( !hash_fits_policy( $sha256, { algorithm => 'SHA256' } ) );
+$ok += ok( hash_fits_policy( '$6$rounds=5000$abc$x', {} ) );
+$ok += ok( hash_fits_policy( $md5, { algorithm => '1' } ) );
+$ok += ok( !hash_fits_policy( 'abcdefgh', {} ) );
+
+my $dir = tempdir( CLEANUP => 1 );
+spew( "$dir/users",  "ada $md5\nbob  $md5\ncarol $md5\n" );
+spew( "$dir/sorted", "ada $md5\nbob $md5\n" );
+spew( "$dir/passwd", "ada:$md5:1001:1001::/home/ada:/bin/sh\n" );
+
+my ( $conf_fh, $conf_path ) =
+  tempfile( "test-mailpw-XXXXXX", DIR => $dir, UNLINK => 0, SUFFIX => ".conf" );
+print $conf_fh <<"EOF";
+upgrade-queue $dir/upgrades
+foo space $dir/users
+foo space $dir/sorted sorted
+foo passwd $dir/passwd algorithm=SHA256 rounds=10000
+EOF
+close($conf_fh);
+
+my $config = {};
+read_mailpw_config( $conf_path, $config );
+$ok += ok( $config->{upgrade_queue}, "$dir/upgrades" );
+
+# nothing queued
+$ok += ok( drain_upgrades($conf_path), 0 );
+
+# bob's passphrase changed since his was verified, and no file has dan
+spew( "$dir/upgrades",
+        "ada\t$md5\t$sha512\n"
+      . "bob\t$sha256\t$sha512\n"
+      . "dan\t$md5\t$sha512\n"
+      . "partial\t$md5" );
+$ok += ok( drain_upgrades($conf_path), 2 );
+$ok += ok( slurp("$dir/users"),  "ada $sha512\nbob  $md5\ncarol $md5\n" );
+$ok += ok( slurp("$dir/sorted"), "ada $sha512\nbob $md5\n" );
+
+# not per the SHA256 policy of the passwd file
+$ok += ok( slurp("$dir/passwd"), "ada:$md5:1001:1001::/home/ada:/bin/sh\n" );
+$ok += ok( !-e "$dir/upgrades" );
+$ok += ok( !-e "$dir/upgrades.draining" );
+$ok += ok( !-e "$dir/passwd.old" );
+
+# a queue left draining by a failure is applied first
+spew( "$dir/upgrades.draining", "bob\t$md5\t$sha512\n" );
+spew( "$dir/upgrades",          "carol\t$md5\t$sha512\n" );
+drain_upgrades($conf_path);
+$ok += ok( slurp("$dir/users"), "ada $sha512\nbob  $sha512\ncarol $md5\n" );
+drain_upgrades($conf_path);
+$ok += ok( slurp("$dir/users"),
+    "ada $sha512\nbob  $sha512\ncarol $sha512\n" );
+
+# an upgrade per policy, each applied to the files of its policy
+spew( "$dir/sorted", "ada $md5\nbob $md5\n" );
+spew( "$dir/upgrades", "ada\t$md5\t$sha256\n" . "ada\t$md5\t$sha512\n" );
+$ok += ok( drain_upgrades($conf_path), 2 );
+$ok += ok( slurp("$dir/sorted"), "ada $sha512\nbob $md5\n" );
+$ok += ok( slurp("$dir/passwd"),
+    "ada:$sha256:1001:1001::/home/ada:/bin/sh\n" );
+
+# nothing but a hash is written as one, nor for a "user" with delimiters
+my $evil = '$6$aa$x:0:0::/root:/bin/sh userdb_uid=0';
+$ok += ok( !hash_fits_policy( $evil, {} ) );
+$ok += ok( !hash_fits_policy( "$sha512\n", {} ) );
+$ok += ok( !hash_fits_policy( '$6$ab c$x', {} ) );
+spew( "$dir/users", "ada $md5\n" );
+spew( "$dir/upgrades",
+        "ada\t$md5\t$evil\n"
+      . "ada $md5\t$md5\t$sha512\n"
+      . "ada:$md5:1001\t$md5\t$sha256\n" );
+$ok += ok( drain_upgrades($conf_path), 0 );
+$ok += ok( slurp("$dir/users"), "ada $md5\n" );
+$ok += ok( slurp("$dir/passwd"),
+    "ada:$sha256:1001:1001::/home/ada:/bin/sh\n" );
+
+# queued by the verifier
+spew( "$dir/passwd", "eve:$md5:1002:1002::/home/eve:/bin/sh\n" );
+my @verify = (
+    './pwcrypt', '--verify', '--hash=SHA256:10000', '--user=eve',
+    "--upgrade-queue=$dir/upgrades"
+);
+open( my $to_pwcrypt, '|-', @verify ) or die "@verify: $!";
+print $to_pwcrypt "secret\n$md5\n";
+$ok += ok( close($to_pwcrypt) );
+$ok += ok( index( slurp("$dir/upgrades"), "eve\t$md5\t\$5\$rounds=10000\$" ),
+    0 );
+
+$ok += ok( drain_upgrades($conf_path), 1 );
+my ($upgraded) = ( slurp("$dir/passwd") =~ /^eve:([^:]+):/ );
+$ok += ok( crypt( 'secret', $upgraded ), $upgraded );
+
+exit( $ok == $PLANNED ? 0 : 1 );
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/* test-salt-rounds.c */
+/* Copyright (C) 2021 Eric Herman <eric@freesa.org> */
+
+#include "pwcrypt.c"
+#include "test-util.c"
+
+unsigned test_salt_rounds_default(void)
+{
+	unsigned failures = 0;
+
+	failures += check(salt_rounds(NULL) == 0, "NULL");
+	failures += check(salt_rounds("") == 0, "empty");
+	failures += check(salt_rounds("UD23qlwjerf") == 0, "plain salt");
+
+	return failures;
+}
+
+unsigned test_salt_rounds_given(void)
+{
+	unsigned failures = 0;
+
+	unsigned long rounds = salt_rounds("rounds=5000$UD23qlwjerf");
+	failures += check(rounds == 5000, "expected 5000 but was %lu", rounds);
+
+	rounds = salt_rounds("rounds=656000$pinch.of.salt");
+	failures += check(rounds == 656000, "expected 656000 but was %lu",
+			  rounds);
+
+	return failures;
+}
+
+unsigned test_salt_rounds_malformed(void)
+{
+	unsigned failures = 0;
+
+	failures += check(salt_rounds("rounds=$abc") == 0, "no digits");
+	failures += check(salt_rounds("rounds=12abc") == 0, "no '$'");
+	failures += check(salt_rounds("Rounds=12$abc") == 0, "case");
+
+	return failures;
+}
+
+int main(void)
+{
+	unsigned failures = 0;
+
+	failures += run_test(test_salt_rounds_default);
+	failures += run_test(test_salt_rounds_given);
+	failures += run_test(test_salt_rounds_malformed);
+
+	return failures_to_status("test-salt-rounds", failures);
+}
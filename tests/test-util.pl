@@ -0,0 +1,24 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+# test-util.pl: helpers shared by the perl tests, loaded via "do"
+# Copyright (C) 2021 Eric Herman <eric@freesa.org>
+
+use strict;
+use warnings;
+
+sub slurp {
+    my ($path) = @_;
+    open( my $fh, '<', $path ) or die "open '$path': $!";
+    local $/;
+    my $contents = <$fh>;
+    close($fh);
+    return $contents;
+}
+
+sub spew {
+    my ( $path, $contents ) = @_;
+    open( my $fh, '>', $path ) or die "open '$path': $!";
+    print $fh $contents;
+    close($fh) or die "close '$path': $!";
+}
+
+1;
@@ -0,0 +1,235 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/* test-verify.c */
+/* Copyright (C) 2021 Eric Herman <eric@freesa.org> */
+
+#include "pwcrypt.c"
+#include "test-util.c"
+
+const char *passphrase = "Love is infinite, time is not.";
+
+const char *stored_sha512 =
+    "$6$just.a.pinch$oBamM8jgbJcLY0b37N72jEgFkAahssOGbXPFDgXidFG3TYS"
+    "BZvEDk4FhAxXF418fyxgyxUvrj00X5qHAxJ18Z.";
+
+unsigned test_hash_matches_spec(void)
+{
+	unsigned failures = 0;
+	struct pwcrypt_spec spec;
+
+	parse_hash_spec("SHA512", &spec);
+	failures += check(hash_matches_spec(stored_sha512, &spec), "SHA512");
+	failures += check(hash_matches_spec("$6$rounds=5000$abc$x", &spec),
+			  "default rounds given");
+	failures += check(!hash_matches_spec("$5$abc$x", &spec), "SHA256");
+	failures += check(!hash_matches_spec("$1$abc$x", &spec), "MD5");
+	failures += check(!hash_matches_spec("$6$rounds=10000$abc$x", &spec),
+			  "more rounds");
+	failures += check(!hash_matches_spec("abc", &spec), "DES");
+	failures += check(!hash_matches_spec("$6", &spec), "truncated");
+	failures += check(!hash_matches_spec(NULL, &spec), "NULL");
+
+	parse_hash_spec("6:10000", &spec);
+	failures += check(hash_matches_spec("$6$rounds=10000$abc$x", &spec),
+			  "rounds=10000");
+	failures += check(!hash_matches_spec(stored_sha512, &spec),
+			  "default rounds");
+	failures += check(!hash_matches_spec("$6$rounds=100000$abc$x", &spec),
+			  "rounds=100000");
+
+	parse_hash_spec("1", &spec);
+	failures += check(hash_matches_spec("$1$abc$x", &spec), "MD5 spec");
+
+	return failures;
+}
+
+unsigned test_hashes_equal(void)
+{
+	unsigned failures = 0;
+
+	failures += check(hashes_equal("$1$abc$x", "$1$abc$x"), "equal");
+	failures += check(!hashes_equal("$1$abc$x", "$1$abc$y"), "differ");
+	failures += check(!hashes_equal("$1$abc$x", "$1$abc$xy"), "longer");
+	failures += check(!hashes_equal("$1$abc$xy", "$1$abc$x"), "shorter");
+	failures += check(!hashes_equal("", "$"), "empty");
+
+	return failures;
+}
+
+/* runs pwcrypt_verify with the passphrase, then the stored hash, on "in",
+ * returning its result; anything written to out is copied to out_buf */
+int verify(const char *entered, const char *stored, const char *upgrade,
+	   const char *user, const char *queue, char *out_buf,
+	   size_t out_buf_size)
+{
+	char in_buf[512];
+	snprintf(in_buf, sizeof(in_buf), "%s\n%s\n", entered, stored);
+	FILE *in = fmemopen(in_buf, strlen(in_buf), "r");
+	if (!in) {
+		err(EXIT_FAILURE, "fmemopen in_buf");
+	}
+
+	memset(out_buf, 0x00, out_buf_size);
+	FILE *out = fmemopen(out_buf, out_buf_size, "w");
+	if (!out) {
+		err(EXIT_FAILURE, "fmemopen out_buf");
+	}
+
+	struct pwcrypt_spec spec;
+	if (upgrade) {
+		parse_hash_spec(upgrade, &spec);
+	}
+
+	int rv = pwcrypt_verify(out, in, upgrade ? &spec : NULL, user, queue,
+				"mail", in, NULL, NULL);
+	fclose(out);
+	fclose(in);
+
+	return rv;
+}
+
+unsigned test_pwcrypt_verify(void)
+{
+	unsigned failures = 0;
+
+	const size_t out_buf_size = 2048;
+	char out_buf[out_buf_size];
+
+	int rv = verify(passphrase, stored_sha512, NULL, NULL, NULL,
+			out_buf, out_buf_size);
+	failures += check(rv == 0, "rv: %d", rv);
+	failures += check_str(out_buf, "", "'%s'", out_buf);
+
+	rv = verify("Time is infinite.", stored_sha512, "SHA256", NULL, NULL,
+		    out_buf, out_buf_size);
+	failures += check(rv == 1, "rv: %d", rv);
+	failures += check_str(out_buf, "", "'%s'", out_buf);
+
+	/* already per the policy, no new hash */
+	rv = verify(passphrase, stored_sha512, "SHA512:5000", NULL, NULL,
+		    out_buf, out_buf_size);
+	failures += check(rv == 0, "rv: %d", rv);
+	failures += check_str(out_buf, "", "'%s'", out_buf);
+
+	/* not per the policy, a new hash which verifies */
+	rv = verify(passphrase, stored_sha512, "SHA256:10000", NULL, NULL,
+		    out_buf, out_buf_size);
+	failures += check(rv == 0, "rv: %d", rv);
+	const char *prefix = "$5$rounds=10000$";
+	failures += check(strncmp(out_buf, prefix, strlen(prefix)) == 0,
+			  "'%s'", out_buf);
+
+	char upgraded[256];
+	snprintf(upgraded, sizeof(upgraded), "%s", out_buf);
+	chomp_crlf(upgraded, sizeof(upgraded));
+	rv = verify(passphrase, upgraded, "SHA256:10000", NULL, NULL,
+		    out_buf, out_buf_size);
+	failures += check(rv == 0, "rv: %d", rv);
+	failures += check_str(out_buf, "", "'%s'", out_buf);
+
+	return failures;
+}
+
+unsigned test_pwcrypt_verify_queue(void)
+{
+	unsigned failures = 0;
+
+	char queue[] = "/tmp/test-verify-XXXXXX";
+	int fd = mkstemp(queue);
+	if (fd < 0) {
+		err(EXIT_FAILURE, "mkstemp(%s)", queue);
+	}
+	close(fd);
+
+	const size_t out_buf_size = 2048;
+	char out_buf[out_buf_size];
+
+	/* each upgrade is appended */
+	for (int i = 0; i < 2; ++i) {
+		int rv = verify(passphrase, stored_sha512, "SHA256", "ada",
+				queue, out_buf, out_buf_size);
+		failures += check(rv == 0, "rv: %d", rv);
+		failures += check_str(out_buf, "", "'%s'", out_buf);
+	}
+	int rv = verify("Time is infinite.", stored_sha512, "SHA256", "ada",
+			queue, out_buf, out_buf_size);
+	failures += check(rv == 1, "rv: %d", rv);
+
+	FILE *fq = fopen(queue, "r");
+	if (!fq) {
+		err(EXIT_FAILURE, "fopen(%s)", queue);
+	}
+	char line[512];
+	char expected[256];
+	snprintf(expected, sizeof(expected), "ada\t%s\t$5$", stored_sha512);
+	size_t expected_len = strlen(expected);
+	size_t lines = 0;
+	while (fgets(line, sizeof(line), fq)) {
+		++lines;
+		failures += check(strncmp(line, expected, expected_len) == 0,
+				  "'%s'", line);
+	}
+	fclose(fq);
+	unlink(queue);
+	failures += check(lines == 2, "lines: %zu", lines);
+
+	return failures;
+}
+
+/* the stored hash on its own file descriptor, as "--verify-fd" */
+unsigned test_pwcrypt_cli_verify_fd(void)
+{
+	unsigned failures = 0;
+
+	char passphrase_path[] = "/tmp/test-verify-XXXXXX";
+	int fd = mkstemp(passphrase_path);
+	if (fd < 0) {
+		err(EXIT_FAILURE, "mkstemp(%s)", passphrase_path);
+	}
+	dprintf(fd, "%s\n", passphrase);
+	close(fd);
+	if (!freopen(passphrase_path, "r", stdin)) {
+		err(EXIT_FAILURE, "freopen(%s)", passphrase_path);
+	}
+	unlink(passphrase_path);
+
+	int fds[2];
+	if (pipe(fds)) {
+		err(EXIT_FAILURE, "pipe");
+	}
+	dprintf(fds[1], "%s\n", stored_sha512);
+	close(fds[1]);
+
+	char verify_fd[40];
+	snprintf(verify_fd, sizeof(verify_fd), "--verify-fd=%d", fds[0]);
+	char *argv[] = { "pwcrypt", "--verify", verify_fd, NULL };
+	int argc = 3;
+
+	const size_t out_buf_size = 2048;
+	char out_buf[out_buf_size];
+	memset(out_buf, 0x00, out_buf_size);
+	FILE *out = fmemopen(out_buf, out_buf_size, "w");
+	if (!out) {
+		err(EXIT_FAILURE, "fmemopen out_buf");
+	}
+
+	optind = 0;
+	int rv = pwcrypt_cli(argc, argv, out);
+	fclose(out);
+	failures += check(rv == 0, "rv: %d", rv);
+	failures += check_str(out_buf, "", "'%s'", out_buf);
+
+	return failures;
+}
+
+int main(void)
+{
+	unsigned failures = 0;
+
+	failures += run_test(test_hash_matches_spec);
+	failures += run_test(test_hashes_equal);
+	failures += run_test(test_pwcrypt_verify);
+	failures += run_test(test_pwcrypt_verify_queue);
+	failures += run_test(test_pwcrypt_cli_verify_fd);
+
+	return failures_to_status("test-verify", failures);
+}